@@ -37,12 +37,15 @@ Load< Scene > car_scene(LoadTagDefault, []() -> Scene const* {
 		drawable.pipeline.start = mesh.start;
 		drawable.pipeline.count = mesh.count;
 
+		drawable.bounds_min = mesh.min; //(lets Scene::draw skip the drawable when it is out of view)
+		drawable.bounds_max = mesh.max;
+
 	});
 });
 
 Load< Sound::Sample > car_honk_sample(LoadTagDefault, []() -> Sound::Sample const* {
-	return new Sound::Sample(data_path("train_horn.opus"));
-});
+	return new Sound::Sample(data_path("train_horn.opus"), Sound::Sample::Int16);
+}, LoadOnWorkerThread); //(decoding is CPU-only, so it can happen alongside other loading)
 
 BouncyCar::BouncyCar() : scene(*car_scene) {
 	for (auto& transform : scene.transforms) {
@@ -88,10 +91,10 @@ BouncyCar::BouncyCar() : scene(*car_scene) {
 	leftSound = Sound::play_3D(*car_honk_sample, 1.0f, glm::vec3(-10.0f, 0.0f, 0.0f), 12.0f);
 	rightSound = Sound::play_3D(*car_honk_sample, 1.0f, glm::vec3(10.0f, 0.0f, 0.0f), 12.0f);
 
-	upSound->stop();
-	downSound->stop();
-	leftSound->stop();
-	rightSound->stop();
+	upSound.stop();
+	downSound.stop();
+	leftSound.stop();
+	rightSound.stop();
 }
 
 BouncyCar::~BouncyCar() {
@@ -174,6 +177,7 @@ void BouncyCar::update(float elapsed) {
 			for (auto& box : boxes) {
 				if (box.transform->position.y < camera->transform->position.y) {
 					box.transform->position.y += 10.0f;
+					box.transform->mark_dirty();
 				}
 			}
 
@@ -223,6 +227,9 @@ void BouncyCar::update(float elapsed) {
 
 		}
 
+		//(the car was moved through its members, so let the transform cache know)
+		gameCar.transform->mark_dirty();
+
 		UpdateCarBB();
 
 		//std::cout << "isGround: " << gameCar.isGround << "\n";
@@ -294,6 +301,7 @@ void BouncyCar::update(float elapsed) {
 	{
 		for (auto& tile : tiles) {
 			tile->position.y += (gameCar.forwardSpeed + BASE_SPEED) * elapsed;
+			tile->mark_dirty();
 			if (tile->position.y > camera->transform->position.y) {
 
 				tile->position.y = tiles.back()->position.y - 6.0f ;
@@ -314,13 +322,13 @@ void BouncyCar::update(float elapsed) {
 
 	// play audios
 	{
-		//if (left.pressed && leftSound->stopped)
+		//if (left.pressed && leftSound.stopped())
 		//	leftSound = Sound::play_3D(*car_honk_sample, 1.0f, glm::vec3(10.0f, 0.0f, 0.0f), 5.0f);
-		//if (right.pressed && rightSound->stopped)
+		//if (right.pressed && rightSound.stopped())
 		//	rightSound = Sound::play_3D(*car_honk_sample, 1.0f, glm::vec3(-10.0f, 0.0f, 0.0f), 5.0f);
-		//if (up.pressed && upSound->stopped)
+		//if (up.pressed && upSound.stopped())
 		//	upSound = Sound::play_3D(*car_honk_sample, 1.0f, glm::vec3(0.0f, -10.0f, 0.0f), 5.0f);
-		//if (down.pressed && downSound->stopped)
+		//if (down.pressed && downSound.stopped())
 		//	downSound = Sound::play_3D(*car_honk_sample, 1.0f, glm::vec3(0.0f, 0.0f, 0.0f), 5.0f);
 
 	}
@@ -338,6 +346,7 @@ void BouncyCar::update(float elapsed) {
 
 			float ofs = (rand() % 5 + 1) * 20.0f;
 			box.transform->position = tiles.back()->position + glm::vec3(0.0f, -ofs, 0.0f);
+			box.transform->mark_dirty();
 			//box.sfx = Sound::play_3D(*car_honk_sample, 1.0f, box.transform->position, 5.0f);
 
 			boxes.emplace_back(box);
@@ -353,13 +362,14 @@ void BouncyCar::update(float elapsed) {
 		for (auto& box : boxes) {
 			if (box.transform->position.y < camera->transform->position.y) {
 				box.transform->position.y += (3.0f * BASE_SPEED) * elapsed;
+				box.transform->mark_dirty();
 				if (box.transform->position.y > -80.0f) {
-					if (box.sfx == nullptr || box.sfx->stopped) {
+					if (box.sfx.stopped()) {
 						box.sfx = Sound::play_3D(*car_honk_sample, 1.0f, box.transform->position, 5.0f);
 					}
 
-					if (!box.sfx->stopped) {
-						box.sfx->set_position(box.transform->position);
+					if (!box.sfx.stopped()) {
+						box.sfx.set_position(box.transform->position);
 					}
 				}
 			}
@@ -551,6 +561,7 @@ void BouncyCar::draw(glm::uvec2 const& drawable_size) {
 
 	GL_ERRORS(); //print any errors produced by this setup code
 
+	scene.update_world_matrices(); //(so the draw below uses cached matrices)
 	scene.draw(*camera);
 
 	{ //use DrawLines to overlay some text:
@@ -68,7 +68,7 @@ struct BouncyCar : Mode {
 
 	struct GameBox {
 		Scene::Transform* transform;
-		std::shared_ptr< Sound::PlayingSample > sfx;
+		Sound::PlayingSample sfx;
 	};
 
 	bool gameOver = false;
@@ -99,10 +99,10 @@ struct BouncyCar : Mode {
 	std::vector<GameBox> boxes;
 
 	//music coming from the tip of the leg (as a demonstration):
-	std::shared_ptr< Sound::PlayingSample > upSound;
-	std::shared_ptr< Sound::PlayingSample > downSound;
-	std::shared_ptr< Sound::PlayingSample > leftSound;
-	std::shared_ptr< Sound::PlayingSample > rightSound;
+	Sound::PlayingSample upSound;
+	Sound::PlayingSample downSound;
+	Sound::PlayingSample leftSound;
+	Sound::PlayingSample rightSound;
 
 	//help functions
 	void SetCarRotation();
@@ -2,19 +2,33 @@
 
 #include <array>
 #include <list>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <exception>
+#include <algorithm>
 #include <cassert>
 
 namespace {
-	std::array< std::list< std::function< void() > >, MaxLoadTag > &get_load_lists() {
-		static std::array< std::list< std::function< void() > >, MaxLoadTag > load_lists;
+	struct LoadLists {
+		std::list< std::function< void() > > main; //run on the main thread, in order
+		std::list< std::function< void() > > workers; //run on worker threads, in any order
+	};
+	std::array< LoadLists, MaxLoadTag > &get_load_lists() {
+		static std::array< LoadLists, MaxLoadTag > load_lists;
 		return load_lists;
 	}
 }
 
-void add_load_function(LoadTag tag, std::function< void() > const &fn) {
+void add_load_function(LoadTag tag, std::function< void() > const &fn, LoadThread thread) {
 	auto &load_lists = get_load_lists();
 	assert(tag < load_lists.size());
-	load_lists[tag].emplace_back(fn);
+	if (thread == LoadOnWorkerThread) {
+		load_lists[tag].workers.emplace_back(fn);
+	} else {
+		load_lists[tag].main.emplace_back(fn);
+	}
 }
 
 void call_load_functions() {
@@ -23,10 +37,50 @@ void call_load_functions() {
 	has_been_called = true;
 
 	auto &load_lists = get_load_lists();
-	for (auto &fn_list : load_lists) {
-		while (!fn_list.empty()) {
-			(*fn_list.begin())(); //call first function in the list
-			fn_list.pop_front(); //remove from list
+	for (auto &lists : load_lists) {
+		//start worker-thread functions running:
+		std::vector< std::function< void() > > jobs(lists.workers.begin(), lists.workers.end());
+		lists.workers.clear();
+
+		std::atomic< uint32_t > next_job(0);
+		std::mutex error_mutex;
+		std::exception_ptr error; //first exception thrown by a job
+
+		auto run_jobs = [&]() {
+			for (uint32_t i = next_job++; i < jobs.size(); i = next_job++) {
+				try {
+					jobs[i]();
+				} catch (...) {
+					std::lock_guard< std::mutex > lock(error_mutex);
+					if (!error) error = std::current_exception();
+				}
+			}
+		};
+
+		std::vector< std::thread > workers;
+		uint32_t worker_count = std::min< uint32_t >(uint32_t(jobs.size()), std::max(1U, std::thread::hardware_concurrency()));
+		workers.reserve(worker_count);
+		for (uint32_t w = 0; w < worker_count; ++w) {
+			workers.emplace_back(run_jobs);
 		}
+
+		//meanwhile, call main-thread functions in order:
+		try {
+			while (!lists.main.empty()) {
+				(*lists.main.begin())(); //call first function in the list
+				lists.main.pop_front(); //remove from list
+			}
+		} catch (...) {
+			//make sure workers are done before unwinding (they reference locals above):
+			next_job = uint32_t(jobs.size());
+			for (auto &worker : workers) worker.join();
+			throw;
+		}
+
+		//then help with (and wait for) any remaining worker-thread functions:
+		run_jobs();
+		for (auto &worker : workers) worker.join();
+
+		if (error) std::rethrow_exception(error);
 	}
 }
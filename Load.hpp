@@ -20,6 +20,16 @@
  * These functions are grouped by 'tags', which allow some sequencing of calls.
  * (particularly, this is useful for loading large data blobs [e.g. Meshes] before looking up individual elements within them.)
  *
+ * Loading functions that are CPU-only (no OpenGL calls; e.g., decoding audio) can be marked LoadOnWorkerThread,
+ * in which case they run in parallel on a pool of worker threads:
+ *
+ * Load< Sound::Sample > music(LoadTagDefault, []() -> Sound::Sample const * {
+ *     return new Sound::Sample(data_path("music.opus"));
+ * }, LoadOnWorkerThread);
+ *
+ * All of a tag's functions (main thread and worker thread) finish before any functions from the next tag start.
+ * (since worker-thread functions run at the same time, any progress messages they print should be written as whole lines)
+ *
  */
 
 #include <functional>
@@ -32,12 +42,17 @@ enum LoadTag : uint32_t {
 	MaxLoadTag //<-- just used to track # of load tags
 };
 
+enum LoadThread : uint32_t {
+	LoadOnMainThread, //function may use OpenGL, so must run on the main thread (in the order it was added)
+	LoadOnWorkerThread, //function is CPU-only (and thread-safe), so may run on a worker thread alongside others
+};
+
 //Add a function to an internal list of loading functions:
 // (only call *before* "call_load_functions()")
-void add_load_function(LoadTag tag, std::function< void() > const &fn);
+void add_load_function(LoadTag tag, std::function< void() > const &fn, LoadThread thread = LoadOnMainThread);
 
 //Call all loading functions:
-// (loading functions may throw exceptions if they fail.)
+// (loading functions may throw exceptions if they fail; exceptions from worker threads are re-thrown here.)
 // (only call *once*)
 void call_load_functions();
 
@@ -49,13 +64,13 @@ T const *new_T() { return new T; }
 template< typename T >
 struct Load {
 	//Constructing a Load< T > adds the passed function to the list of functions to call:
-	Load(LoadTag tag, const std::function< T const *() > &load_fn = new_T< T >) : value(nullptr) {
+	Load(LoadTag tag, const std::function< T const *() > &load_fn = new_T< T >, LoadThread thread = LoadOnMainThread) : value(nullptr) {
 		add_load_function(tag, [this,load_fn](){
 			this->value = load_fn();
 			if (!(this->value)) {
 				throw std::runtime_error("Loading failed.");
 			}
-		});
+		}, thread);
 	}
 
 	//Make a "Load< T >" behave like a "T const *":
@@ -73,8 +88,8 @@ struct Load {
 template< >
 struct Load< void > {
 	//Constructing a Load< T > adds the passed function to the list of functions to call:
-	Load( LoadTag tag, const std::function< void() > &load_fn) {
-		add_load_function(tag, load_fn);
+	Load( LoadTag tag, const std::function< void() > &load_fn, LoadThread thread = LoadOnMainThread) {
+		add_load_function(tag, load_fn, thread);
 	}
 };
 
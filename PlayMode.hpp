@@ -40,7 +40,7 @@ struct PlayMode : Mode {
 	glm::vec3 get_leg_tip_position();
 
 	//music coming from the tip of the leg (as a demonstration):
-	std::shared_ptr< Sound::PlayingSample > leg_tip_loop;
+	Sound::PlayingSample leg_tip_loop;
 	
 	//camera:
 	Scene::Camera *camera = nullptr;
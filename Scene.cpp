@@ -5,11 +5,24 @@
 
 #include <glm/gtc/type_ptr.hpp>
 
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
 #include <fstream>
+#include <cstring>
+#include <cmath>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+#include <atomic>
 
 //-------------------------
 
-glm::mat4x3 Scene::Transform::make_local_to_parent() const {
+//helpers: build matrices from position/rotation/scale:
+static glm::mat4x3 build_local_to_parent(glm::vec3 const &position, glm::quat const &rotation, glm::vec3 const &scale) {
 	//compute:
 	//   translate   *   rotate    *   scale
 	// [ 1 0 0 p.x ]   [       0 ]   [ s.x 0 0 0 ]
@@ -26,7 +39,7 @@ glm::mat4x3 Scene::Transform::make_local_to_parent() const {
 	);
 }
 
-glm::mat4x3 Scene::Transform::make_parent_to_local() const {
+static glm::mat4x3 build_parent_to_local(glm::vec3 const &position, glm::quat const &rotation, glm::vec3 const &scale) {
 	//compute:
 	//   1/scale       *    rot^-1   *  translate^-1
 	// [ 1/s.x 0 0 0 ]   [       0 ]   [ 0 0 0 -p.x ]
@@ -56,21 +69,395 @@ glm::mat4x3 Scene::Transform::make_parent_to_local() const {
 	);
 }
 
-glm::mat4x3 Scene::Transform::make_local_to_world() const {
+//source of Transform::Cache::generation values:
+// (update_world_matrices() reserves a whole block of them at once)
+static std::atomic< uint64_t > next_generation{ 0 };
+
+//number of transform edits made through setters or mark_dirty(), to compare with Transform::Cache::checked:
+static std::atomic< uint64_t > transform_edits{ 0 };
+
+void Scene::Transform::mark_dirty() {
+	cache.dirty = true;
+	transform_edits.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Scene::Transform::update_cache() const {
+	//nothing edited anywhere since the last check? (the value comparison catches direct writes to this transform)
+	uint64_t edits = transform_edits.load(std::memory_order_relaxed);
+	if (cache.checked == edits && !cache.dirty && parent == cache.parent
+	 && position == cache.position && rotation == cache.rotation && scale == cache.scale) {
+		return;
+	}
+
+	//rebuild local matrices if position/rotation/scale changed since they were built:
+	bool local_changed = cache.dirty
+		|| position != cache.position
+		|| rotation != cache.rotation
+		|| scale != cache.scale;
+	if (local_changed) {
+		cache.position = position;
+		cache.rotation = rotation;
+		cache.scale = scale;
+		cache.local_to_parent = build_local_to_parent(position, rotation, scale);
+	}
+
+	//rebuild world matrices if local matrices or parent's world matrices changed:
+	uint64_t parent_generation = 0;
+	if (parent) {
+		parent->update_cache();
+		parent_generation = parent->cache.generation;
+	}
+	if (local_changed || parent != cache.parent || parent_generation != cache.parent_generation) {
+		if (!parent) {
+			cache.local_to_world = cache.local_to_parent;
+		} else {
+			cache.local_to_world = parent->cache.local_to_world * glm::mat4(cache.local_to_parent); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
+		}
+		cache.inverse_ready = false;
+		cache.parent = parent;
+		cache.parent_generation = parent_generation;
+		cache.generation = next_generation.fetch_add(1, std::memory_order_relaxed) + 1;
+	}
+	cache.dirty = false;
+	cache.checked = edits;
+}
+
+//helper: make sure the inverse matrices are up to date, assuming update_cache() was already called:
+// (inverses are only built when asked for, since most transforms never need them)
+void Scene::Transform::update_inverse_cache() const {
+	if (cache.inverse_ready) return;
+	cache.parent_to_local = build_parent_to_local(cache.position, cache.rotation, cache.scale);
 	if (!parent) {
-		return make_local_to_parent();
+		cache.world_to_local = cache.parent_to_local;
 	} else {
-		return parent->make_local_to_world() * glm::mat4(make_local_to_parent()); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
+		parent->update_inverse_cache();
+		cache.world_to_local = cache.parent_to_local * glm::mat4(parent->cache.world_to_local);
 	}
+	cache.inverse_ready = true;
+}
+
+glm::mat4x3 Scene::Transform::make_local_to_parent() const {
+	update_cache();
+	return cache.local_to_parent;
+}
+
+glm::mat4x3 Scene::Transform::make_parent_to_local() const {
+	update_cache();
+	update_inverse_cache();
+	return cache.parent_to_local;
+}
+
+glm::mat4x3 Scene::Transform::make_local_to_world() const {
+	update_cache();
+	return cache.local_to_world;
 }
+
 glm::mat4x3 Scene::Transform::make_world_to_local() const {
-	if (!parent) {
-		return make_parent_to_local();
-	} else {
-		return make_parent_to_local() * glm::mat4(parent->make_world_to_local()); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
+	update_cache();
+	update_inverse_cache();
+	return cache.world_to_local;
+}
+
+//-------------------------
+
+//update_world_matrices() splits scenes with at least this many transforms between threads:
+static constexpr uint32_t const ParallelMinTransforms = 8192;
+static constexpr uint32_t const TransformsPerThread = 4096;
+
+//Worker threads for update_world_matrices(), started the first time a scene is large enough to split up, and kept
+// for the rest of the program (so each call only wakes them instead of creating threads):
+struct ScenePool {
+	std::vector< std::thread > threads;
+
+	//current job: (all protected by 'mutex')
+	std::mutex mutex;
+	std::condition_variable wake; //workers wait here for parts to claim
+	std::condition_variable finished; //run() waits here for claimed parts to finish
+	std::function< void(uint32_t) > const *job = nullptr;
+	uint32_t parts = 0; //parts in job
+	uint32_t next_part = 0; //next part to claim
+	uint32_t remaining = 0; //parts not finished yet
+	bool quit = false;
+
+	std::mutex running; //one run() at a time (e.g., scenes being updated on different threads)
+
+	//call fn(part) for each part in [0, parts), on the calling thread and the workers:
+	void run(uint32_t parts_, std::function< void(uint32_t) > const &fn) {
+		std::lock_guard< std::mutex > run_lock(running);
+		if (threads.empty()) {
+			uint32_t count = std::max(1U, std::thread::hardware_concurrency()) - 1;
+			for (uint32_t i = 0; i < count; ++i) threads.emplace_back(&ScenePool::work, this);
+		}
+
+		std::unique_lock< std::mutex > lock(mutex);
+		job = &fn;
+		parts = parts_;
+		next_part = 0;
+		remaining = parts_;
+		wake.notify_all();
+		//claim parts here too:
+		while (next_part < parts) {
+			uint32_t part = next_part++;
+			lock.unlock();
+			fn(part);
+			lock.lock();
+			--remaining;
+		}
+		finished.wait(lock, [this](){ return remaining == 0; });
+		job = nullptr;
+	}
+
+	void work() {
+		std::unique_lock< std::mutex > lock(mutex);
+		for (;;) {
+			wake.wait(lock, [this](){ return quit || (job && next_part < parts); });
+			if (quit) return;
+			uint32_t part = next_part++;
+			std::function< void(uint32_t) > const &fn = *job;
+			lock.unlock();
+			fn(part);
+			lock.lock();
+			if (--remaining == 0) finished.notify_all();
+		}
+	}
+
+	~ScenePool() {
+		{
+			std::lock_guard< std::mutex > lock(mutex);
+			quit = true;
+		}
+		wake.notify_all();
+		for (auto &thread : threads) thread.join();
+	}
+};
+
+//helper: rebuild the flattened hierarchy if transforms were added, removed, or re-parented since it was built:
+static void update_hierarchy(ChunkedPool< Scene::Transform > const &transforms, Scene::Hierarchy &h) {
+	//check if anything changed:
+	// (compares against pointers from the live list, so removed transforms are never dereferenced)
+	bool changed = (transforms.size() != h.listed.size());
+	if (!changed) {
+		uint32_t i = 0;
+		for (auto const &t : transforms) {
+			if (&t != h.listed[i] || t.parent != h.listed_parents[i]) {
+				changed = true;
+				break;
+			}
+			++i;
+		}
+	}
+	if (!changed) return;
+
+	uint32_t count = uint32_t(transforms.size());
+	h.listed.clear();
+	h.listed_parents.clear();
+	std::unordered_map< Scene::Transform const *, uint32_t > listed_index;
+	for (auto const &t : transforms) {
+		listed_index.emplace(&t, uint32_t(h.listed.size()));
+		h.listed.emplace_back(&t);
+		h.listed_parents.emplace_back(t.parent);
+	}
+
+	//gather children of each transform (and roots, including transforms whose parent is outside the scene):
+	std::vector< uint32_t > child_start(count + 1, 0);
+	std::vector< uint32_t > children(count);
+	std::vector< uint32_t > roots;
+	std::vector< uint32_t > listed_parent(count, -1U);
+	for (uint32_t i = 0; i < count; ++i) {
+		auto f = listed_index.find(h.listed_parents[i]);
+		if (f == listed_index.end()) {
+			roots.emplace_back(i);
+		} else {
+			listed_parent[i] = f->second;
+			++child_start[f->second + 1];
+		}
+	}
+	for (uint32_t i = 0; i < count; ++i) {
+		child_start[i + 1] += child_start[i];
+	}
+	{
+		std::vector< uint32_t > next(child_start.begin(), child_start.end() - 1);
+		for (uint32_t i = 0; i < count; ++i) {
+			if (listed_parent[i] != -1U) children[next[listed_parent[i]]++] = i;
+		}
+	}
+
+	//depth-first order: (transforms in a parent cycle are never reached, and are left out)
+	h.order.clear();
+	h.parent.clear();
+	h.outside_parents.clear();
+	std::vector< uint32_t > order_index(count, -1U);
+	std::vector< uint32_t > stack;
+	for (uint32_t r = uint32_t(roots.size()) - 1; r < roots.size(); --r) {
+		stack.emplace_back(roots[r]);
+	}
+	while (!stack.empty()) {
+		uint32_t i = stack.back();
+		stack.pop_back();
+		order_index[i] = uint32_t(h.order.size());
+		h.order.emplace_back(h.listed[i]);
+		if (listed_parent[i] != -1U) {
+			h.parent.emplace_back(order_index[listed_parent[i]]);
+		} else if (h.listed_parents[i]) {
+			h.parent.emplace_back(count + uint32_t(h.outside_parents.size()));
+			h.outside_parents.emplace_back(h.listed_parents[i]);
+		} else {
+			h.parent.emplace_back(-1U);
+		}
+		//(push children in reverse so they come out in list order)
+		for (uint32_t c = child_start[i + 1]; c > child_start[i]; --c) {
+			stack.emplace_back(children[c - 1]);
+		}
+	}
+	//outside parent indices were counted from 'count', but transforms left out of the order shift them down:
+	for (auto &p : h.parent) {
+		if (p != -1U && p >= count) p = p - count + uint32_t(h.order.size());
+	}
+
+	uint32_t ordered = uint32_t(h.order.size());
+	for (auto &v : h.trs) v.resize(ordered);
+	for (auto &v : h.local) v.resize(ordered);
+	h.world.resize(ordered);
+	h.outside_worlds.resize(h.outside_parents.size());
+}
+
+//helper: compute local matrices for transforms [begin, end) of the hierarchy from their position/rotation/scale:
+// (same math as build_local_to_parent, written over component arrays so the compiler can vectorize it)
+static void compute_local_matrices(Scene::Hierarchy &h, uint32_t begin, uint32_t end) {
+	float const *px = h.trs[0].data(), *py = h.trs[1].data(), *pz = h.trs[2].data();
+	float const *qx = h.trs[3].data(), *qy = h.trs[4].data(), *qz = h.trs[5].data(), *qw = h.trs[6].data();
+	float const *sx = h.trs[7].data(), *sy = h.trs[8].data(), *sz = h.trs[9].data();
+	float *m[12];
+	for (uint32_t e = 0; e < 12; ++e) m[e] = h.local[e].data();
+
+	for (uint32_t i = begin; i < end; ++i) {
+		//rotation matrix (as in glm::mat3_cast):
+		float qxx = qx[i] * qx[i], qyy = qy[i] * qy[i], qzz = qz[i] * qz[i];
+		float qxz = qx[i] * qz[i], qxy = qx[i] * qy[i], qyz = qy[i] * qz[i];
+		float qwx = qw[i] * qx[i], qwy = qw[i] * qy[i], qwz = qw[i] * qz[i];
+
+		//columns scaled by scale, then translation:
+		m[0][i] = (1.0f - 2.0f * (qyy + qzz)) * sx[i];
+		m[1][i] = (2.0f * (qxy + qwz)) * sx[i];
+		m[2][i] = (2.0f * (qxz - qwy)) * sx[i];
+		m[3][i] = (2.0f * (qxy - qwz)) * sy[i];
+		m[4][i] = (1.0f - 2.0f * (qxx + qzz)) * sy[i];
+		m[5][i] = (2.0f * (qyz + qwx)) * sy[i];
+		m[6][i] = (2.0f * (qxz + qwy)) * sz[i];
+		m[7][i] = (2.0f * (qyz - qwx)) * sz[i];
+		m[8][i] = (1.0f - 2.0f * (qxx + qyy)) * sz[i];
+		m[9][i] = px[i];
+		m[10][i] = py[i];
+		m[11][i] = pz[i];
 	}
 }
 
+//helper: compute world matrices for transforms [begin, end) of the hierarchy and store them in the transforms' caches:
+// transforms in the range may have parents before 'begin' -- in depth-first order, those are all ancestors of
+// transform 'begin' -- and since another thread may be computing those, this range recomputes them for itself.
+static void compute_world_matrices(Scene::Hierarchy &h, uint32_t begin, uint32_t end, uint64_t first_generation, uint64_t edits) {
+	uint32_t count = uint32_t(h.order.size());
+	auto local = [&h](uint32_t i) {
+		return glm::mat4x3(
+			glm::vec3(h.local[0][i], h.local[1][i], h.local[2][i]),
+			glm::vec3(h.local[3][i], h.local[4][i], h.local[5][i]),
+			glm::vec3(h.local[6][i], h.local[7][i], h.local[8][i]),
+			glm::vec3(h.local[9][i], h.local[10][i], h.local[11][i])
+		);
+	};
+
+	//world matrices of ancestors of 'begin' that come before it:
+	std::vector< std::pair< uint32_t, glm::mat4x3 > > ancestors;
+	for (uint32_t a = (begin < end ? h.parent[begin] : -1U); a != -1U && a < count; a = h.parent[a]) {
+		ancestors.emplace_back(a, glm::mat4x3(1.0f));
+	}
+	for (uint32_t i = uint32_t(ancestors.size()) - 1; i < ancestors.size(); --i) {
+		uint32_t a = ancestors[i].first;
+		uint32_t p = h.parent[a];
+		if (p == -1U) ancestors[i].second = local(a);
+		else if (p >= count) ancestors[i].second = h.outside_worlds[p - count] * glm::mat4(local(a));
+		else ancestors[i].second = ancestors[i + 1].second * glm::mat4(local(a));
+	}
+
+	for (uint32_t i = begin; i < end; ++i) {
+		uint32_t p = h.parent[i];
+		glm::mat4x3 const *parent_world = nullptr;
+		if (p == -1U) {
+			//root
+		} else if (p >= count) {
+			parent_world = &h.outside_worlds[p - count];
+		} else if (p >= begin) {
+			parent_world = &h.world[p];
+		} else {
+			for (auto const &a : ancestors) {
+				if (a.first == p) parent_world = &a.second;
+			}
+			assert(parent_world && "parents before 'begin' are ancestors of 'begin'");
+		}
+		glm::mat4x3 local_to_parent = local(i);
+		h.world[i] = (parent_world ? *parent_world * glm::mat4(local_to_parent) : local_to_parent);
+
+		//store results in the transform's cache, exactly as update_cache() would have:
+		Scene::Transform const &t = *h.order[i];
+		Scene::Transform::Cache &cache = t.cache;
+		cache.dirty = false;
+		cache.checked = edits;
+		cache.position = t.position;
+		cache.rotation = t.rotation;
+		cache.scale = t.scale;
+		cache.local_to_parent = local_to_parent;
+		cache.local_to_world = h.world[i];
+		cache.inverse_ready = false;
+		cache.parent = t.parent;
+		cache.parent_generation = (p == -1U ? 0 : p >= count ? t.parent->cache.generation : first_generation + p);
+		cache.generation = first_generation + i;
+	}
+}
+
+void Scene::update_world_matrices() const {
+	Hierarchy &h = hierarchy;
+	update_hierarchy(transforms, h);
+	uint32_t count = uint32_t(h.order.size());
+
+	//gather position/rotation/scale:
+	for (uint32_t i = 0; i < count; ++i) {
+		Transform const &t = *h.order[i];
+		h.trs[0][i] = t.position.x; h.trs[1][i] = t.position.y; h.trs[2][i] = t.position.z;
+		h.trs[3][i] = t.rotation.x; h.trs[4][i] = t.rotation.y; h.trs[5][i] = t.rotation.z; h.trs[6][i] = t.rotation.w;
+		h.trs[7][i] = t.scale.x; h.trs[8][i] = t.scale.y; h.trs[9][i] = t.scale.z;
+	}
+	for (uint32_t i = 0; i < h.outside_parents.size(); ++i) {
+		h.outside_worlds[i] = h.outside_parents[i]->make_local_to_world();
+	}
+
+	//hand out a block of generation numbers (the transform at index i gets first_generation + i):
+	uint64_t first_generation = next_generation.fetch_add(count, std::memory_order_relaxed) + 1;
+	uint64_t edits = transform_edits.load(std::memory_order_relaxed);
+
+	//split large scenes into equal ranges, one per thread:
+	uint32_t parts = 1;
+	if (count >= ParallelMinTransforms) {
+		parts = std::max(1U, std::min(std::thread::hardware_concurrency(), count / TransformsPerThread));
+	}
+	auto range_begin = [count, parts](uint32_t part) { return uint32_t(uint64_t(count) * part / parts); };
+	auto run_parts = [parts](std::function< void(uint32_t) > const &fn) {
+		if (parts == 1) {
+			fn(0);
+			return;
+		}
+		static ScenePool pool;
+		pool.run(parts, fn);
+	};
+
+	//local matrices first, since world matrices for a range can depend on local matrices of ancestors in other ranges:
+	run_parts([&](uint32_t part) {
+		compute_local_matrices(h, range_begin(part), range_begin(part + 1));
+	});
+	run_parts([&](uint32_t part) {
+		compute_world_matrices(h, range_begin(part), range_begin(part + 1), first_generation, edits);
+	});
+}
+
 //-------------------------
 
 glm::mat4 Scene::Camera::make_projection() const {
@@ -87,9 +474,122 @@ void Scene::draw(Camera const &camera) const {
 	draw(world_to_clip, world_to_light);
 }
 
+//View frustum culling:
+// a point is in view when -w <= x,y,z <= w for (x,y,z,w) = world_to_clip * point, and each of those six
+// inequalities is a plane in world space: (row 3 +/- row i of world_to_clip) . point >= 0.
+//Planes are stored as separate arrays of components, padded to eight with always-passing planes,
+// so a box can be tested against four planes at a time:
+struct FrustumPlanes {
+	alignas(16) float nx[8], ny[8], nz[8], d[8];
+};
+
+static FrustumPlanes make_frustum_planes(glm::mat4 const &world_to_clip) {
+	FrustumPlanes planes;
+	for (uint32_t i = 0; i < 8; ++i) {
+		float p[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+		if (i < 6) {
+			uint32_t row = i / 2;
+			float sign = (i % 2 == 0 ? 1.0f : -1.0f);
+			for (uint32_t c = 0; c < 4; ++c) {
+				p[c] = world_to_clip[c][3] + sign * world_to_clip[c][row];
+			}
+		}
+		planes.nx[i] = p[0];
+		planes.ny[i] = p[1];
+		planes.nz[i] = p[2];
+		planes.d[i] = p[3];
+	}
+	return planes;
+}
+
+//is any part of the box with center 'c' and half-size 'e' (in world space) inside all of the planes?
+// (a box is outside a plane if its center is farther outside than the box's extent along the plane's normal)
+static bool box_in_frustum(FrustumPlanes const &planes, glm::vec3 const &c, glm::vec3 const &e) {
+#if defined(__x86_64__) || defined(_M_X64)
+	__m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	__m128 cx = _mm_set1_ps(c.x), cy = _mm_set1_ps(c.y), cz = _mm_set1_ps(c.z);
+	__m128 ex = _mm_set1_ps(e.x), ey = _mm_set1_ps(e.y), ez = _mm_set1_ps(e.z);
+	__m128 outside = _mm_setzero_ps();
+	for (uint32_t i = 0; i < 8; i += 4) {
+		__m128 nx = _mm_load_ps(planes.nx + i), ny = _mm_load_ps(planes.ny + i), nz = _mm_load_ps(planes.nz + i);
+		__m128 distance = _mm_add_ps(
+			_mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)),
+			_mm_add_ps(_mm_mul_ps(nz, cz), _mm_load_ps(planes.d + i))
+		);
+		__m128 radius = _mm_add_ps(
+			_mm_add_ps(_mm_mul_ps(_mm_and_ps(nx, abs_mask), ex), _mm_mul_ps(_mm_and_ps(ny, abs_mask), ey)),
+			_mm_mul_ps(_mm_and_ps(nz, abs_mask), ez)
+		);
+		outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+	}
+	return _mm_movemask_ps(outside) == 0;
+#else
+	for (uint32_t i = 0; i < 8; ++i) {
+		float distance = planes.nx[i] * c.x + planes.ny[i] * c.y + planes.nz[i] * c.z + planes.d[i];
+		float radius = std::abs(planes.nx[i]) * e.x + std::abs(planes.ny[i]) * e.y + std::abs(planes.nz[i]) * e.z;
+		if (distance + radius < 0.0f) return false;
+	}
+	return true;
+#endif
+}
+
+//Draw ordering: drawables are sorted by a 64-bit key so that drawables sharing GL state end up next to each other:
+// [ program : 12 | vao : 12 | texture set : 16 | depth : 24 ]
+// (ids are truncated and texture sets hashed -- that only makes grouping a little less perfect, since
+//  the submission loop compares actual state before skipping a bind -- and depth sorts near-to-far within a group)
+static uint64_t make_draw_key(Scene::Drawable::Pipeline const &pipeline, float depth) {
+	uint32_t textures = 0;
+	for (uint32_t i = 0; i < Scene::Drawable::Pipeline::TextureCount; ++i) {
+		textures = textures * 0x9E3779B1U + pipeline.textures[i].texture * 2654435761U + pipeline.textures[i].target;
+	}
+	textures = (textures ^ (textures >> 16)) & 0xffff;
+	//(non-negative floats sort the same way as their bit patterns; 24 bits keeps the exponent and 15 bits of mantissa)
+	depth = std::max(depth, 0.0f);
+	uint32_t depth_bits;
+	std::memcpy(&depth_bits, &depth, sizeof(depth_bits));
+	return (uint64_t(pipeline.program & 0xfff) << 52)
+	     | (uint64_t(pipeline.vao & 0xfff) << 40)
+	     | (uint64_t(textures) << 24)
+	     | uint64_t(depth_bits >> 7);
+}
+
+//sort draw list items by key with a (stable) least-significant-digit radix sort, one byte at a time:
+// (skips bytes that are the same in every key -- often most of them, since scenes use few programs and vaos)
+static void radix_sort(std::vector< Scene::DrawItem > *items_, std::vector< Scene::DrawItem > *scratch_) {
+	auto &items = *items_;
+	auto &scratch = *scratch_;
+	scratch.resize(items.size());
+
+	//count every byte of every key in one pass:
+	uint32_t counts[8][256] = { };
+	for (auto const &item : items) {
+		for (uint32_t b = 0; b < 8; ++b) {
+			++counts[b][(item.key >> (8 * b)) & 0xff];
+		}
+	}
+	for (uint32_t b = 0; b < 8; ++b) {
+		//skip this byte if every key has the same value for it:
+		if (counts[b][(items[0].key >> (8 * b)) & 0xff] == items.size()) continue;
+
+		uint32_t offsets[256];
+		uint32_t total = 0;
+		for (uint32_t v = 0; v < 256; ++v) {
+			offsets[v] = total;
+			total += counts[b][v];
+		}
+		for (auto const &item : items) {
+			scratch[offsets[(item.key >> (8 * b)) & 0xff]++] = item;
+		}
+		std::swap(items, scratch);
+	}
+}
+
 void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light) const {
+	draw_stats = DrawStats();
+	FrustumPlanes planes = make_frustum_planes(world_to_clip);
 
-	//Iterate through all drawables, sending each one to OpenGL:
+	//Gather drawables that are in view into the draw list:
+	draw_list.clear();
 	for (auto const &drawable : drawables) {
 		//Reference to drawable's pipeline for convenience:
 		Scene::Drawable::Pipeline const &pipeline = drawable.pipeline;
@@ -101,19 +601,83 @@ void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_lig
 		//skip any drawables that don't contain any vertices:
 		if (pipeline.count == 0) continue;
 
+		//the object-to-world matrix is used for culling, sorting, and in all three of the uniforms below:
+		// (after update_world_matrices(), with nothing edited since, this is the matrix it stored in the transform's cache,
+		//  returned without rebuilding anything or walking up the hierarchy)
+		assert(drawable.transform); //drawables *must* have a transform
+		glm::mat4x3 object_to_world = drawable.transform->make_local_to_world();
+
+		//skip drawables whose bounds are out of view:
+		glm::vec3 center = object_to_world[3];
+		if (drawable.bounds_min.x <= drawable.bounds_max.x) {
+			//world-space box around the (transformed) local box:
+			glm::vec3 local_center = 0.5f * (drawable.bounds_min + drawable.bounds_max);
+			glm::vec3 local_extent = 0.5f * (drawable.bounds_max - drawable.bounds_min);
+			center = object_to_world * glm::vec4(local_center, 1.0f);
+			glm::vec3 extent = glm::abs(glm::vec3(object_to_world[0])) * local_extent.x
+			                 + glm::abs(glm::vec3(object_to_world[1])) * local_extent.y
+			                 + glm::abs(glm::vec3(object_to_world[2])) * local_extent.z;
+			if (!box_in_frustum(planes, center, extent)) {
+				++draw_stats.culled;
+				continue;
+			}
+		}
+
+		//depth for sorting is clip 'w' (distance along the view direction, for perspective projections):
+		float depth = world_to_clip[0][3] * center.x + world_to_clip[1][3] * center.y + world_to_clip[2][3] * center.z + world_to_clip[3][3];
+
+		DrawItem item;
+		item.key = (sort_draws ? make_draw_key(pipeline, depth) : 0);
+		item.drawable = &drawable;
+		item.object_to_world = object_to_world;
+		draw_list.emplace_back(item);
+	}
+
+	if (sort_draws && !draw_list.empty()) radix_sort(&draw_list, &draw_list_scratch);
+
+	//Submit the draw list, only changing GL state when it differs from the previous drawable's:
+	//(the program and vao bound on entry aren't known, so the first drawable always sets them;
+	// texture units are assumed to be empty on entry -- as draw() has always assumed -- and are left empty on exit)
+	bool program_known = false;
+	GLuint bound_program = 0;
+	bool vao_known = false;
+	GLuint bound_vao = 0;
+	Drawable::Pipeline::TextureInfo bound_textures[Drawable::Pipeline::TextureCount];
+	uint32_t active_texture = -1U; //(unknown until first set)
+	//without the checks below, every drawable would set the program and vao, and bind and then un-bind each of its textures:
+	uint32_t unsorted_state_changes = 0;
+	auto set_active_texture = [&active_texture](uint32_t i) {
+		if (i != active_texture) {
+			glActiveTexture(GL_TEXTURE0 + i);
+			active_texture = i;
+		}
+	};
+
+	for (auto const &item : draw_list) {
+		//Reference to drawable's pipeline for convenience:
+		Scene::Drawable::Pipeline const &pipeline = item.drawable->pipeline;
+		glm::mat4x3 const &object_to_world = item.object_to_world;
+		++draw_stats.drawn;
+		unsorted_state_changes += 2;
 
 		//Set shader program:
-		glUseProgram(pipeline.program);
+		if (!program_known || pipeline.program != bound_program) {
+			glUseProgram(pipeline.program);
+			program_known = true;
+			bound_program = pipeline.program;
+			++draw_stats.state_changes;
+		}
 
 		//Set attribute sources:
-		glBindVertexArray(pipeline.vao);
+		if (!vao_known || pipeline.vao != bound_vao) {
+			glBindVertexArray(pipeline.vao);
+			vao_known = true;
+			bound_vao = pipeline.vao;
+			++draw_stats.state_changes;
+		}
 
 		//Configure program uniforms:
 
-		//the object-to-world matrix is used in all three of these uniforms:
-		assert(drawable.transform); //drawables *must* have a transform
-		glm::mat4x3 object_to_world = drawable.transform->make_local_to_world();
-
 		//OBJECT_TO_CLIP takes vertices from object space to clip space:
 		if (pipeline.OBJECT_TO_CLIP_mat4 != -1U) {
 			glm::mat4 object_to_clip = world_to_clip * glm::mat4(object_to_world);
@@ -137,31 +701,51 @@ void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_lig
 		//set any requested custom uniforms:
 		if (pipeline.set_uniforms) pipeline.set_uniforms();
 
-		//set up textures:
+		//set up textures: (units this drawable doesn't use are emptied, so it never samples an earlier drawable's texture)
 		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
-			if (pipeline.textures[i].texture != 0) {
-				glActiveTexture(GL_TEXTURE0 + i);
-				glBindTexture(pipeline.textures[i].target, pipeline.textures[i].texture);
+			Drawable::Pipeline::TextureInfo const &want = pipeline.textures[i];
+			Drawable::Pipeline::TextureInfo &bound = bound_textures[i];
+			if (want.texture == 0) {
+				if (bound.texture != 0) {
+					set_active_texture(i);
+					glBindTexture(bound.target, 0);
+					bound = Drawable::Pipeline::TextureInfo();
+					++draw_stats.state_changes;
+				}
+				continue;
 			}
+			unsorted_state_changes += 2;
+			if (want.texture == bound.texture && want.target == bound.target) continue;
+			set_active_texture(i);
+			//(don't leave a texture bound to some other target of this unit)
+			if (bound.texture != 0 && bound.target != want.target) {
+				glBindTexture(bound.target, 0);
+				++draw_stats.state_changes;
+			}
+			glBindTexture(want.target, want.texture);
+			bound = want;
+			++draw_stats.state_changes;
 		}
 
 		//draw the object:
 		glDrawArrays(pipeline.type, pipeline.start, pipeline.count);
+	}
 
-		//un-bind textures:
-		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
-			if (pipeline.textures[i].texture != 0) {
-				glActiveTexture(GL_TEXTURE0 + i);
-				glBindTexture(pipeline.textures[i].target, 0);
-			}
+	//un-bind textures:
+	for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
+		if (bound_textures[i].texture != 0) {
+			set_active_texture(i);
+			glBindTexture(bound_textures[i].target, 0);
+			++draw_stats.state_changes;
 		}
-		glActiveTexture(GL_TEXTURE0);
-
 	}
+	glActiveTexture(GL_TEXTURE0);
 
 	glUseProgram(0);
 	glBindVertexArray(0);
 
+	draw_stats.state_changes_saved = std::max(unsorted_state_changes, draw_stats.state_changes) - draw_stats.state_changes;
+
 	GL_ERRORS();
 }
 
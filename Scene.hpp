@@ -11,16 +11,19 @@
  */
 
 #include "GL.hpp"
+#include "chunked_pool.hpp"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 
-#include <list>
+#include <array>
 #include <memory>
 #include <functional>
 #include <string>
 #include <vector>
 #include <unordered_map>
+#include <cstdint>
+#include <limits>
 
 struct Scene {
 	struct Transform {
@@ -43,6 +46,39 @@ struct Scene {
 		glm::mat4x3 make_local_to_world() const;
 		glm::mat4x3 make_world_to_local() const;
 
+		//These matrices are cached, so asking for them again is cheap when nothing has changed:
+		// each transform remembers the position/rotation/scale/parent its matrices were built from, and rebuilds
+		// them only if those differ or if its parent's world matrix changed.
+		//The setters below also count the change, and as long as no transform has changed since a transform's cache was
+		// last checked, checking it again is O(1); otherwise it visits each ancestor (comparing values -- no matrix math).
+		// (so writing the members above directly is fine for a transform without children, but a parent edited directly
+		//  needs a mark_dirty() so its children notice)
+		// n.b. since even the const functions update the cache, don't call them on one hierarchy from several threads at once
+		void set_position(glm::vec3 const &position_) { position = position_; mark_dirty(); }
+		void set_rotation(glm::quat const &rotation_) { rotation = rotation_; mark_dirty(); }
+		void set_scale(glm::vec3 const &scale_) { scale = scale_; mark_dirty(); }
+		void set_parent(Transform *parent_) { parent = parent_; mark_dirty(); }
+		//mark_dirty() forces a rebuild on the next call (and has children recheck against this transform):
+		void mark_dirty();
+
+		//cached matrices and what they were built from: (updated by update_cache())
+		struct Cache {
+			bool dirty = true; //rebuild everything next time?
+			uint64_t checked = -1ULL; //transform edit count (see mark_dirty) when this cache was last known to be up to date
+			glm::vec3 position = glm::vec3(0.0f);
+			glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+			glm::vec3 scale = glm::vec3(1.0f);
+			Transform const *parent = nullptr;
+			uint64_t parent_generation = 0; //parent's 'generation' when local_to_world was built
+			uint64_t generation = 0; //changes whenever local_to_world is rebuilt (unique across all transforms)
+			glm::mat4x3 local_to_parent, local_to_world;
+			bool inverse_ready = false; //are the inverses below up to date?
+			glm::mat4x3 parent_to_local, world_to_local;
+		};
+		mutable Cache cache;
+		void update_cache() const;
+		void update_inverse_cache() const;
+
 		//since hierarchy is tracked through pointers, copy-constructing a transform  is not advised:
 		Transform(Transform const &) = delete;
 		//if we delete some constructors, we need to let the compiler know that the default constructor is still okay:
@@ -54,6 +90,11 @@ struct Scene {
 		Drawable(Transform *transform_) : transform(transform_) { assert(transform); }
 		Transform * transform;
 
+		//(optional) bounding box in the transform's local space, e.g., from Mesh::min/max;
+		// draw() skips drawables whose box is entirely outside the view. (an empty box -- the default -- is never skipped)
+		glm::vec3 bounds_min = glm::vec3( std::numeric_limits< float >::infinity());
+		glm::vec3 bounds_max = glm::vec3(-std::numeric_limits< float >::infinity());
+
 		//Contains all the data needed to run the OpenGL pipeline:
 		struct Pipeline {
 			GLuint program = 0; //shader program; passed to glUseProgram
@@ -117,10 +158,36 @@ struct Scene {
 	};
 
 	//Scenes, of course, may have many of the above objects:
-	std::list< Transform > transforms;
-	std::list< Drawable > drawables;
-	std::list< Camera > cameras;
-	std::list< Light > lights;
+	// (stored in chunks, so pointers to them stay valid as more are added; see chunked_pool.hpp)
+	ChunkedPool< Transform > transforms;
+	ChunkedPool< Drawable > drawables;
+	ChunkedPool< Camera > cameras;
+	ChunkedPool< Light > lights;
+
+	//Compute every transform's world matrix in one pass, storing the results in each transform's cache
+	// (so later make_local_to_world() calls -- e.g., from draw() -- don't rebuild anything):
+	// call once per frame after moving things around; large scenes are split between threads (started once and reused).
+	// (const for the same reason make_local_to_world() is: it only updates caches)
+	void update_world_matrices() const;
+
+	//Flattened copy of the transform hierarchy used by update_world_matrices():
+	// transforms are ordered depth-first (so parents come before children, and each subtree is a contiguous range),
+	// with parents as indices and position/rotation/scale/local matrices as one array per component.
+	// Rebuilt whenever transforms are added, removed, or re-parented.
+	struct Hierarchy {
+		std::vector< Transform const * > listed; //'transforms' in list order, as of the last rebuild (to notice changes)
+		std::vector< Transform const * > listed_parents; //...and their parents
+		std::vector< Transform const * > order; //transforms in depth-first order
+		std::vector< uint32_t > parent; //index in 'order' of each transform's parent, or -1U for roots
+		//transforms whose parent isn't in this scene get their parent's world matrix from the parent itself:
+		std::vector< Transform const * > outside_parents; //(parent index is order.size() + index in this list)
+		std::vector< glm::mat4x3 > outside_worlds;
+		//per-transform data, one array per component:
+		std::array< std::vector< float >, 10 > trs; //position xyz, rotation xyzw, scale xyz
+		std::array< std::vector< float >, 12 > local; //local-to-parent matrix entries (column-major)
+		std::vector< glm::mat4x3 > world; //local-to-world matrices
+	};
+	mutable Hierarchy hierarchy;
 
 	//The "draw" function provides a convenient way to pass all the things in a scene to OpenGL:
 	void draw(Camera const &camera) const;
@@ -128,6 +195,28 @@ struct Scene {
 	//..sometimes, you want to draw with a custom projection matrix and/or light space:
 	void draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light = glm::mat4x3(1.0f)) const;
 
+	//draw() sorts drawables to group ones with the same program, vertex array, and textures (then near-to-far),
+	// and skips binding things that are already bound; turn this off if drawing order matters (e.g., for blending).
+	// (texture units should be empty when draw() is called; it leaves them empty, with no program or vertex array bound)
+	bool sort_draws = true;
+
+	//counts from the most recent draw() call, for debug overlays:
+	struct DrawStats {
+		uint32_t drawn = 0; //drawables sent to OpenGL
+		uint32_t culled = 0; //drawables skipped because their bounds were outside the view
+		uint32_t state_changes = 0; //program, vertex array, and texture binds
+		uint32_t state_changes_saved = 0; //binds skipped because the state was already set
+	};
+	mutable DrawStats draw_stats;
+
+	//per-draw scratch space: drawables in view, with their sort keys:
+	struct DrawItem {
+		uint64_t key;
+		Drawable const *drawable;
+		glm::mat4x3 object_to_world;
+	};
+	mutable std::vector< DrawItem > draw_list, draw_list_scratch;
+
 	//add transforms/objects/cameras from a scene file to this scene:
 	// the 'on_drawable' callback gives your code a chance to look up mesh data and make Drawables:
 	// throws on file format errors
@@ -91,6 +91,7 @@ void ShowSceneMode::draw(glm::uvec2 const &drawable_size) {
 	glEnable(GL_DEPTH_TEST);
 	glDepthFunc(GL_LEQUAL);
 
+	scene.update_world_matrices(); //(so the draw below uses cached matrices)
 	scene.draw(*scene_camera);
 
 	{ //decorate with some lines:
@@ -1,30 +1,325 @@
 #include "Sound.hpp"
 #include "load_wav.hpp"
 #include "load_opus.hpp"
+#include "pcm_cache.hpp"
+#include "mix_kernel.hpp"
+#include "adpcm.hpp"
+#include "convolution_reverb.hpp"
 
 #include <SDL.h>
 
-#include <list>
+#include <vector>
+#include <memory>
+#include <array>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
 #include <cassert>
 #include <exception>
 #include <iostream>
 #include <algorithm>
+#include <type_traits>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#elif defined(_M_ARM64)
+#include <intrin.h>
+#endif
 
 //local (to this file) data used by the audio system:
 namespace {
 
 	//handy constants:
 	constexpr uint32_t const AUDIO_RATE = 48000; //sampling rate
-	constexpr uint32_t const MIX_SAMPLES = 1024; //number of samples to mix per call of mix_audio callback; n.b. SDL requires this to be a power of two
+	constexpr uint32_t const MAX_MIX_SAMPLES = 4096; //largest block size Sound::init() accepts
+
+	//number of samples to mix per call of mix_audio callback (set by Sound::init); n.b. SDL requires this to be a power of two
+	uint32_t mix_samples = 1024;
+	float block_time = float(mix_samples) / float(AUDIO_RATE); //duration of a block in seconds
 
 	//The audio device:
 	SDL_AudioDeviceID device = 0;
 
-	//list of all currently playing samples:
-	std::list< std::shared_ptr< Sound::PlayingSample > > playing_samples;
+	//Sound::render() mixes whole blocks; frames left over from the last block it mixed wait here:
+	std::array< float, 2 * MAX_MIX_SAMPLES > render_block;
+	uint32_t render_block_used = MAX_MIX_SAMPLES; //frames of render_block already handed out (>= mix_samples means "none left")
+
+	//Table of playing voices, stored as parallel arrays ("structure of arrays") so the mixer walks memory linearly:
+	// voices [0, count) are playing; finished voices are swap-removed to keep the table dense.
+	// (only touched by the audio callback, or while the audio device is locked)
+	struct Voices {
+		uint32_t count = 0;
+		std::array< void const *, Sound::MaxVoices > data; //sample data being played
+		std::array< Sound::Sample::Encoding, Sound::MaxVoices > encoding; //encoding of sample data
+		std::array< uint32_t, Sound::MaxVoices > length; //length of sample data
+		std::array< uint32_t, Sound::MaxVoices > cursor; //next data value to read
+		std::array< ADPCMPosition, Sound::MaxVoices > adpcm; //where ADPCM decoding left off (ADPCM data only)
+		std::array< Sound::StreamSample::Stream *, Sound::MaxVoices > stream; //stream being played (instead of data), if any
+		std::array< uint8_t, Sound::MaxVoices > flags; //combination of Loop, Stopping, and Real
+		std::array< float, Sound::MaxVoices > priority; //higher priority voices are mixed first when over the real voice budget
+		std::array< uint64_t, Sound::MaxVoices > started; //order voices were started in (for Sound::StealOldest)
+		std::array< uint64_t, Sound::MaxVoices > start_sample; //audio clock sample to start playing at (see Sound::play_at)
+		std::array< Sound::Ramp< float >, Sound::MaxVoices > volume;
+		//2D playback panning control: ('NaN' if sound played in 3D mode)
+		std::array< Sound::Ramp< float >, Sound::MaxVoices > pan;
+		//3D playback panning control: ('NaN' if sound played in 2D mode)
+		std::array< Sound::Ramp< glm::vec3 >, Sound::MaxVoices > position;
+		std::array< Sound::Ramp< float >, Sound::MaxVoices > half_volume_radius;
+		std::array< Sound::Ramp< float >, Sound::MaxVoices > reverb_send; //level sent to the reverb bus (see Sound::set_reverb)
+		std::array< uint32_t, Sound::MaxVoices > slot; //slot (handle index) of each voice
+
+		enum : uint8_t {
+			Loop = 1, //should playback loop after data runs out?
+			Stopping = 2, //is playing stopping?
+			Real = 4, //was voice mixed last block? (if not, it is "virtual" and only its position advances)
+		};
+	};
+	Voices voices;
+	uint32_t playing_voices = 0; //voices that aren't Stopping (what counts against voice_capacity)
+	uint64_t voices_started = 0; //total voices started (source of Voices::started)
+
+	//Audio clock: samples mixed since the mixer started (only advanced by the audio callback; read by Sound::audio_time):
+	std::atomic< uint64_t > mixed_samples{ 0 };
+	uint64_t block_start_sample = 0; //audio callback only: clock at the start of the block being mixed
+
+	//Voice capacity: (only touched by the audio callback; see Sound::set_voice_capacity)
+	uint32_t voice_capacity = Sound::MaxVoices;
+	Sound::VoiceOverflow voice_overflow = Sound::RejectNew;
+
+	//Reverb send bus: (see Sound::set_reverb)
+	// voices with a reverb send also mix into send_bus, which is run through 'reverb' once per block and added to the output,
+	// so the cost of the reverb doesn't depend on how many voices use it.
+	ConvolutionReverb *reverb = nullptr; //audio callback only (nullptr == no reverb)
+	alignas(32) std::array< float, 2 * MAX_MIX_SAMPLES > send_bus; //interleaved stereo (audio callback only)
+	alignas(32) std::array< float, MAX_MIX_SAMPLES > reverb_input; //send_bus mixed down to mono (audio callback only)
+	//reverbs are created and freed by the game thread; each has an id, and the callback reports the id of the one it is using
+	// so that Sound::collect() knows when older ones are safe to free:
+	std::vector< std::pair< uint32_t, std::unique_ptr< ConvolutionReverb > > > reverbs; //game thread only
+	uint32_t next_reverb_id = 1; //game thread only
+	std::atomic< uint32_t > reverb_in_use{ 0 };
+
+	//Voice virtualization: (only touched by the audio callback)
+	// each block, voices quieter than audible_threshold become virtual (their cursor advances, but nothing is mixed),
+	// and if more than max_real_voices are left, only the ones with the highest priority * loudness are mixed.
+	uint32_t max_real_voices = Sound::MaxVoices;
+	float audible_threshold = 1e-4f; //(-80dB)
+
+	//per-block scratch space for the mixer:
+	struct VoiceGains {
+		float start_l, start_r; //gains at the start of the block
+		float end_l, end_r; //gains at the end of the block
+		float send_start, send_end; //reverb send levels at the start and end of the block (as a fraction of the gains above)
+	};
+	std::array< VoiceGains, Sound::MaxVoices > voice_gains;
+	std::array< float, Sound::MaxVoices > voice_score; //priority * loudness
+	std::array< uint8_t, Sound::MaxVoices > voice_selected; //will voice be real this block?
+	//3D voices' positions at the start and end of the block, gathered so they can all be panned at once by pan_3d():
+	struct PanSources {
+		alignas(32) std::array< float, Sound::MaxVoices > x, y, z, radius;
+		alignas(32) std::array< float, Sound::MaxVoices > left, right; //(output)
+	};
+	PanSources pan_start, pan_end;
+	std::array< uint32_t, Sound::MaxVoices > pan_voices; //voice index for each entry in pan_start/pan_end
+	std::array< uint32_t, Sound::MaxVoices > audible_voices; //indices of voices louder than audible_threshold
+	std::array< uint8_t, Sound::MaxVoices > voice_finished; //did voice finish this block?
+	std::array< uint32_t, Sound::MaxVoices > finished_voices; //indices of voices to retire after mixing
+
+	//Mixing threads: (optional; see Sound::init)
+	// each block, the audio callback splits voices into contiguous ranges and mixes the first itself; the rest are
+	// claimed one at a time by the mixing threads -- or by the callback, once it's done with the first range, so it
+	// only ever waits on ranges a thread is already partway through. Threads mix into per-range scratch buffers,
+	// which the callback then adds into its output.
+	struct MixPool {
+		struct Range {
+			alignas(64) std::array< float, 2 * MAX_MIX_SAMPLES > buffer; //scratch output (interleaved stereo)
+			alignas(64) std::array< float, 2 * MAX_MIX_SAMPLES > send_buffer; //scratch reverb send (interleaved stereo)
+			uint32_t begin = 0, end = 0; //voices to mix
+			bool in_out = false; //mixed by the callback straight into its output (so nothing to add)?
+		};
+		std::vector< std::unique_ptr< Range > > ranges; //ranges after the first (as many as there are workers)
+
+		struct Worker {
+			std::thread thread;
+			SDL_sem *wake = nullptr; //posted by the audio callback to unpark the worker
+			std::atomic< bool > parked{ false }; //waiting on (or about to wait on) 'wake'?
+		};
+		std::vector< std::unique_ptr< Worker > > workers;
+
+		//the current block's ranges, packed into one word so a range can be claimed with one compare-exchange:
+		// block number in the high 32 bits, then range count (16 bits), then next range to claim (16 bits)
+		std::atomic< uint64_t > work{ 0 };
+		std::atomic< uint32_t > done{ 0 }; //ranges finished by workers this block
+		bool sending = false; //mix reverb sends this block? (set before 'work' is published)
+		std::atomic< bool > quit{ false };
+	};
+	MixPool *mix_pool = nullptr;
+	constexpr uint32_t const MIX_VOICES_PER_THREAD = 64; //don't bother splitting up fewer mixed voices than this
+	constexpr std::chrono::microseconds const MIX_WORKER_SPIN{ 100 }; //how long workers spin after a block before parking
+
+	//helper: hint to the CPU that this is a spin-wait loop (saves power, and gives a hyperthreaded sibling the core):
+	inline void spin_pause() {
+	#if defined(__x86_64__) || defined(_M_X64)
+		_mm_pause();
+	#elif defined(_M_ARM64)
+		__yield();
+	#elif defined(__aarch64__) || defined(__arm__)
+		__asm__ __volatile__("yield");
+	#endif
+	}
+
+	//Statistics, written by the audio callback and read by Sound::get_stats():
+	// (relaxed atomics, so reading them never blocks the callback; values may be from slightly different callbacks)
+	struct {
+		std::atomic< uint64_t > callbacks{ 0 };
+		std::array< std::atomic< uint64_t >, Sound::Stats::DurationBuckets > duration_histogram{ };
+		std::atomic< float > budget_used{ 0.0f };
+		std::atomic< float > peak_budget_used{ 0.0f };
+		std::atomic< uint64_t > late_callbacks{ 0 };
+		std::atomic< uint32_t > voices{ 0 };
+		std::atomic< uint32_t > real_voices{ 0 };
+		std::atomic< uint32_t > peak_voices{ 0 };
+		std::atomic< uint64_t > voices_added{ 0 };
+		std::atomic< uint64_t > voices_removed{ 0 };
+		std::atomic< uint64_t > voices_rejected{ 0 };
+		std::atomic< uint64_t > voices_stolen{ 0 };
+		std::atomic< float > voices_added_per_second{ 0.0f };
+		std::atomic< float > voices_removed_per_second{ 0.0f };
+	} stats;
+	//audio callback only:
+	std::chrono::steady_clock::time_point stats_last_callback; //when the previous callback started
+	uint32_t stats_window_samples = 0; //samples mixed since per-second rates were last updated
+	uint64_t stats_window_added = 0; //voices_added when per-second rates were last updated
+	uint64_t stats_window_removed = 0;
+
+	//Voice slots are what PlayingSample handles refer to; they stay put while voices move around the table.
+	// slot_voice is only used by the audio callback; slot_generation is bumped by the audio callback when a voice finishes.
+	//There are enough slots for a full voice table plus a full command queue of AddVoice commands,
+	// so the game thread never runs out of slots -- running out of voices is handled by the audio callback (see Sound::VoiceOverflow).
+	constexpr uint32_t const MAX_SLOTS = 2 * Sound::MaxVoices;
+	std::array< uint32_t, MAX_SLOTS > slot_voice; //index into voices, or -1U if slot isn't playing
+	std::array< std::atomic< uint32_t >, MAX_SLOTS > slot_generation;
+
+	//Slots not currently in use (only touched by the game thread):
+	std::vector< uint32_t > free_slots;
+
+	//Commands carry changes from the game thread to the audio callback:
+	// pointers in commands (sample, stream, reverb) never own what they point to -- the game thread keeps those alive
+	// until the audio callback is done with them (see Sound::collect()) -- so applying a command never frees memory:
+	struct Command {
+		enum Type : uint8_t {
+			AddVoice, //start playing 'sample' (or 'stream') in 'slot'
+			SetVolume, //voice volume <- value.x
+			SetPan, //voice pan <- value.x
+			SetPosition, //voice position <- value
+			SetHalfVolumeRadius, //voice half_volume_radius <- value.x
+			SetPriority, //voice priority <- value.x
+			Stop, //fade out and remove voice
+			StopAll, //fade out and remove all playing voices
+			SetGlobalVolume, //Sound::volume <- value.x
+			SetListener, //Sound::listener.position <- value, Sound::listener.right <- value2
+			SetVoiceLimits, //max_real_voices <- slot, audible_threshold <- value.x
+			SetVoiceCapacity, //voice_capacity <- slot, voice_overflow <- generation
+			SetReverbSend, //voice reverb_send <- value.x
+			SetReverb, //reverb <- reverb, reverb_in_use <- slot
+		} type = AddVoice;
+		//for per-voice commands:
+		uint32_t slot = -1U;
+		uint32_t generation = 0;
+		//for AddVoice (which also uses 'value' for position):
+		Sound::Sample const *sample = nullptr;
+		Sound::StreamSample::Stream *stream = nullptr;
+		uint32_t stream_restart = 0; //restart of the stream to play from
+		uint64_t start_sample = 0; //audio clock sample to start at (0 == as soon as possible)
+		bool loop = false;
+		float volume = 1.0f;
+		float pan = 0.0f;
+		float half_volume_radius = 0.0f;
+		//parameters:
+		glm::vec3 value = glm::vec3(0.0f);
+		glm::vec3 value2 = glm::vec3(0.0f);
+		float ramp = 0.0f;
+		//for SetReverb:
+		ConvolutionReverb *reverb = nullptr;
+	};
+	static_assert(std::is_trivially_destructible< Command >::value, "commands can't own anything the audio callback would have to free");
+
+	//Wait-free single-producer / single-consumer ring:
+	template< typename T, uint32_t Size >
+	struct SPSCQueue {
+		static_assert((Size & (Size-1)) == 0, "Queue size must be a power of two.");
+		std::array< T, Size > items;
+		std::atomic< uint32_t > head{ 0 }; //next item to read; written only by the consumer
+		std::atomic< uint32_t > tail{ 0 }; //next item to write; written only by the producer
+
+		//returns false (and leaves 'item' alone) if the queue is full:
+		bool push(T &&item) {
+			uint32_t t = tail.load(std::memory_order_relaxed);
+			if (t - head.load(std::memory_order_acquire) == Size) return false;
+			items[t & (Size-1)] = std::move(item);
+			tail.store(t + 1, std::memory_order_release);
+			return true;
+		}
+		//returns false if the queue is empty:
+		bool pop(T *item) {
+			uint32_t h = head.load(std::memory_order_relaxed);
+			if (h == tail.load(std::memory_order_acquire)) return false;
+			*item = std::move(items[h & (Size-1)]);
+			head.store(h + 1, std::memory_order_release);
+			return true;
+		}
+	};
+
+	//commands from the game thread to the audio callback:
+	SPSCQueue< Command, 4096 > command_queue;
+	static_assert(MAX_SLOTS >= Sound::MaxVoices + 4096, "enough slots for every voice and every queued AddVoice");
+
+	//slots of finished voices, from the audio callback back to the game thread:
+	// (can't overflow: it has room for every slot)
+	SPSCQueue< uint32_t, MAX_SLOTS > retired_slots;
 
 }
 
+//A stream's decoded samples live in a ring buffer between the decoding thread and the audio callback:
+struct Sound::StreamSample::Stream {
+	Stream(std::string const &filename);
+	~Stream();
+
+	//only used by the decoding thread (after construction):
+	OpusStreamDecoder decoder;
+
+	//decoded samples: [read_pos, write_pos) are ready to play
+	// (positions count samples since the stream was opened; wrap them with '& (Capacity-1)' to index the ring)
+	static constexpr uint32_t const Capacity = 1 << 17; //~2.7 seconds; n.b. must be a power of two
+	std::vector< float > ring;
+	std::atomic< uint64_t > write_pos{ 0 }; //written by the decoding thread
+	std::atomic< uint64_t > read_pos{ 0 }; //written by the audio callback
+	std::atomic< uint64_t > end_pos{ -1ULL }; //where the file ends, if decoding reached the end without looping
+
+	//restarting: (requested by the game thread, carried out by the decoding thread)
+	std::atomic< bool > loop{ false }; //at the end of the file, seek back to the start and keep decoding?
+	std::atomic< uint32_t > restart_request{ 0 }; //written by the game thread
+	std::atomic< uint32_t > restart_done{ 0 }; //written by the decoding thread; samples for this restart begin at restart_pos
+	std::atomic< uint64_t > restart_pos{ 0 };
+	bool played = false; //game thread only: the first play uses the samples decoded since the file was opened
+
+	//game thread only: set up a restart (if needed) and return the number of the restart to play from:
+	uint32_t restart(bool loop);
+
+	//audio callback only:
+	uint32_t mixer_restart = 0; //restart the current voice is playing from
+	bool mixer_synced = true; //has the current voice found the start of its restart in the ring?
+	uint32_t mixer_slot = -1U; //slot of the voice currently playing this stream
+
+	//decoding thread:
+	std::atomic< bool > quit{ false };
+	std::mutex mutex; //(only used to wait on 'wake')
+	std::condition_variable wake;
+	std::thread thread;
+	void decode_loop();
+};
+
 //public-facing data:
 
 //global volume control:
@@ -36,24 +331,206 @@ Sound::Listener Sound::listener;
 //This audio-mixing callback is defined below:
 void mix_audio(void *, Uint8 *buffer_, int len);
 
+//Command queue helpers are also defined below:
+void send_command(Command &&command);
+void drain_commands();
+void retire_voice(uint32_t v);
+
+//Mixing thread helpers are also defined below:
+void set_mix_threads(uint32_t count);
+
 //------------------------ public-facing --------------------------------
 
-Sound::Sample::Sample(std::string const &filename) {
+//helper: re-encode a sample's float data, if it should be stored some other way:
+static void encode_sample(Sound::Sample *sample, Sound::Sample::Encoding encoding) {
+	assert(sample->encoding == Sound::Sample::Float);
+	if (encoding == Sound::Sample::Float) return;
+
+	float const *data = sample->samples();
+	size_t size = sample->size();
+	if (encoding == Sound::Sample::Int16) {
+		sample->data_int16.resize(size);
+		for (size_t i = 0; i < size; ++i) {
+			sample->data_int16[i] = int16_t(std::max(-32768.0f, std::min(32767.0f, std::round(data[i] * 32768.0f))));
+		}
+	} else if (encoding == Sound::Sample::ADPCM) {
+		encode_adpcm(data, size, &sample->data_adpcm);
+		sample->adpcm_size = size;
+	} else {
+		throw std::runtime_error("Unknown sample encoding " + std::to_string(int(encoding)) + ".");
+	}
+	sample->encoding = encoding;
+
+	//release the float version:
+	sample->data = std::vector< float >();
+	sample->cache.reset();
+}
+
+Sound::Sample::Sample(std::string const &filename, Encoding encoding_) {
 	if (filename.size() >= 4 && filename.substr(filename.size()-4) == ".wav") {
 		load_wav(filename, &data);
 	} else if (filename.size() >= 5 && filename.substr(filename.size()-5) == ".opus") {
-		load_opus(filename, &data);
+		//decoding is slow, so use (or make) a cache of the decoded samples:
+		cache = map_pcm_cache(filename);
+		if (!cache) {
+			load_opus(filename, &data);
+			save_pcm_cache(filename, data);
+		}
 	} else {
 		throw std::runtime_error("Sample '" + filename + "' doesn't end in either \".png\" or \".opus\" -- unsure how to load.");
 	}
+	encode_sample(this, encoding_);
+}
+
+Sound::Sample::Sample(std::vector< float > const &data_, Encoding encoding_) : data(data_) {
+	encode_sample(this, encoding_);
+}
+
+float const *Sound::Sample::samples() const {
+	if (encoding != Float) return nullptr;
+	return (cache ? cache->data : data.data());
+}
+
+size_t Sound::Sample::size() const {
+	if (encoding == Int16) return data_int16.size();
+	if (encoding == ADPCM) return adpcm_size;
+	return (cache ? cache->size : data.size());
 }
 
-Sound::Sample::Sample(std::vector< float > const &data_) : data(data_) {
+size_t Sound::Sample::bytes() const {
+	if (encoding == Int16) return data_int16.size() * sizeof(int16_t);
+	if (encoding == ADPCM) return data_adpcm.size();
+	return size() * sizeof(float);
 }
 
+Sound::StreamSample::StreamSample(std::string const &filename) : stream(new Stream(filename)) {
+}
+
+Sound::StreamSample::~StreamSample() {
+	//make sure the audio callback is done with the stream before it is freed:
+	Sound::lock();
+	drain_commands(); //(safe because the audio callback can't run right now)
+	for (uint32_t v = 0; v < voices.count; /* later */) {
+		if (voices.stream[v] == stream.get()) {
+			retire_voice(v);
+		} else {
+			++v;
+		}
+	}
+	Sound::unlock();
+}
 
+Sound::StreamSample::Stream::Stream(std::string const &filename) : decoder(filename) {
+	ring.resize(Capacity, 0.0f);
+	thread = std::thread(&Stream::decode_loop, this);
+}
+
+Sound::StreamSample::Stream::~Stream() {
+	quit = true;
+	wake.notify_one();
+	thread.join();
+}
+
+uint32_t Sound::StreamSample::Stream::restart(bool loop_) {
+	loop.store(loop_, std::memory_order_relaxed);
+	if (!played) {
+		played = true;
+		return 0;
+	}
+	uint32_t request = restart_request.load(std::memory_order_relaxed) + 1;
+	restart_request.store(request, std::memory_order_release);
+	wake.notify_one();
+	return request;
+}
+
+void Sound::StreamSample::Stream::decode_loop() {
+	uint32_t done = 0; //last restart request handled
+	bool ended = false; //reached end of file (and not looping)
+
+	while (!quit.load(std::memory_order_relaxed)) {
+		uint64_t write = write_pos.load(std::memory_order_relaxed);
+		try {
+			//start over from the beginning of the file if requested:
+			uint32_t request = restart_request.load(std::memory_order_acquire);
+			if (request != done) {
+				decoder.seek(0);
+				ended = false;
+				end_pos.store(-1ULL, std::memory_order_relaxed);
+				restart_pos.store(write, std::memory_order_relaxed); //(samples for this restart begin here)
+				restart_done.store(request, std::memory_order_release);
+				done = request;
+			}
+
+			//looping may have been turned on (by the first play) after decoding reached the end:
+			if (ended && loop.load(std::memory_order_relaxed)) {
+				decoder.seek(0);
+				ended = false;
+				end_pos.store(-1ULL, std::memory_order_relaxed);
+			}
+
+			//don't overwrite samples the audio callback hasn't read yet -- even ones from before the current restart,
+			// since a voice playing the old restart may still be reading them (the voice for the new restart moves
+			// read_pos up to restart_pos as soon as it syncs):
+			uint64_t read = read_pos.load(std::memory_order_acquire);
+			uint32_t space = Capacity - uint32_t(write - read);
+			if (ended || space < 960) { //(opus decodes in 20ms / 960 sample packets)
+				//wait for the audio callback to use some samples (or for a restart):
+				std::unique_lock< std::mutex > lock(mutex);
+				wake.wait_for(lock, std::chrono::milliseconds(5));
+				continue;
+			}
+
+			//decode straight into the ring:
+			uint32_t at = uint32_t(write & (Capacity-1));
+			uint32_t count = decoder.read(ring.data() + at, std::min(space, Capacity - at));
+			if (count == 0) {
+				if (loop.load(std::memory_order_relaxed)) {
+					decoder.seek(0); //gapless: keep filling the ring from the start of the file
+				} else {
+					end_pos.store(write, std::memory_order_release);
+					ended = true;
+				}
+			} else {
+				write_pos.store(write + count, std::memory_order_release);
+			}
+		} catch (std::exception &e) {
+			std::cerr << "Stopping stream after error: " << e.what() << std::endl;
+			end_pos.store(write, std::memory_order_release);
+			ended = true;
+		}
+	}
+}
+
+
+
+//helper: mark all voice slots as free:
+void reset_voices() {
+	assert(voices.count == 0); //n.b. (re-)initializing while voices are playing isn't supported
+	free_slots.clear();
+	free_slots.reserve(MAX_SLOTS);
+	for (uint32_t slot = MAX_SLOTS - 1; slot < MAX_SLOTS; --slot) {
+		free_slots.emplace_back(slot);
+		slot_voice[slot] = -1U;
+	}
+	playing_voices = 0;
+	render_block_used = mix_samples;
+}
+
+//helper: set (and check) block size:
+void set_block_size(uint32_t block_size) {
+	if (block_size < 16 || block_size > MAX_MIX_SAMPLES || (block_size & (block_size - 1)) != 0) {
+		std::cerr << "WARNING: audio block size " << block_size << " isn't a power of two between 16 and " << MAX_MIX_SAMPLES << "; using 1024." << std::endl;
+		block_size = 1024;
+	}
+	mix_samples = block_size;
+	block_time = float(mix_samples) / float(AUDIO_RATE);
+}
+
+void Sound::init(uint32_t block_size, uint32_t mix_threads) {
+	set_block_size(block_size);
+	reset_voices();
+	set_mix_threads(mix_threads);
 
-void Sound::init() {
 	if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) {
 		std::cerr << "Failed to initialize SDL audio subsytem:\n" << SDL_GetError() << std::endl;
 		std::cerr << "  (Will continue without audio.)\n" << std::endl;
@@ -66,21 +543,59 @@ void Sound::init() {
 	want.freq = AUDIO_RATE;
 	want.format = AUDIO_F32SYS;
 	want.channels = 2;
-	want.samples = MIX_SAMPLES;
+	want.samples = uint16_t(mix_samples);
 	want.callback = mix_audio;
 
-	device = SDL_OpenAudioDevice(nullptr, 0, &want, &have, 0);
+	device = SDL_OpenAudioDevice(nullptr, 0, &want, &have, 0); //(no allowed changes, so SDL will convert if the hardware differs)
 	if (device == 0) {
 		std::cerr << "Failed to open audio device:\n" << SDL_GetError() << std::endl;
 		std::cerr << "  (Will continue without audio.)\n" << std::endl;
 	} else {
 		//start audio playback:
 		SDL_PauseAudioDevice(device, 0);
-		std::cout << "Audio output initialized." << std::endl;
+		std::cout << "Audio output initialized (" << mix_samples << " sample blocks, mixing with " << mix_kernel_name() << " kernel)." << std::endl;
 	}
 }
 
 
+void Sound::init_headless(uint32_t block_size, uint32_t mix_threads) {
+	set_block_size(block_size);
+	reset_voices();
+	set_mix_threads(mix_threads);
+	std::cout << "Audio initialized without an output device (" << mix_samples << " sample blocks, mixing with " << mix_kernel_name() << " kernel)." << std::endl;
+}
+
+void Sound::render(float *stereo_out, uint32_t frames) {
+	assert(stereo_out);
+	if (device != 0) {
+		throw std::runtime_error("Sound::render() can't be used while an audio device is playing; use Sound::init_headless() instead of Sound::init().");
+	}
+
+	while (frames > 0) {
+		if (render_block_used >= mix_samples) {
+			if (frames >= mix_samples) {
+				//whole block wanted, so mix directly into the output:
+				mix_audio(nullptr, reinterpret_cast< Uint8 * >(stereo_out), int(2 * mix_samples * sizeof(float)));
+				stereo_out += 2 * mix_samples;
+				frames -= mix_samples;
+				continue;
+			}
+			//partial block wanted, so mix into render_block and hand out the rest next time:
+			mix_audio(nullptr, reinterpret_cast< Uint8 * >(render_block.data()), int(2 * mix_samples * sizeof(float)));
+			render_block_used = 0;
+		}
+		uint32_t count = std::min(frames, mix_samples - render_block_used);
+		std::copy(
+			render_block.begin() + 2 * render_block_used,
+			render_block.begin() + 2 * (render_block_used + count),
+			stereo_out
+		);
+		render_block_used += count;
+		stereo_out += 2 * count;
+		frames -= count;
+	}
+}
+
 void Sound::shutdown() {
 	if (device != 0) {
 		//stop audio playback:
@@ -88,6 +603,9 @@ void Sound::shutdown() {
 		SDL_CloseAudioDevice(device);
 		device = 0;
 	}
+	set_mix_threads(0);
+	reverb = nullptr;
+	reverbs.clear();
 }
 
 
@@ -99,114 +617,603 @@ void Sound::unlock() {
 	if (device) SDL_UnlockAudioDevice(device);
 }
 
-std::shared_ptr< Sound::PlayingSample > Sound::play(Sample const &sample, float volume, float pan) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, volume, pan, false);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
+uint32_t Sound::collect() {
+	uint32_t collected = 0;
+	uint32_t slot;
+	while (retired_slots.pop(&slot)) {
+		free_slots.emplace_back(slot); //(never reallocates: free_slots has room for every slot)
+		++collected;
+	}
+
+	//free reverbs the audio callback has moved on from:
+	uint32_t in_use = reverb_in_use.load(std::memory_order_acquire);
+	while (!reverbs.empty() && reverbs.front().first < in_use) {
+		reverbs.erase(reverbs.begin());
+	}
+
+	return collected;
 }
 
-std::shared_ptr< Sound::PlayingSample > Sound::play_3D(Sample const &sample, float volume, glm::vec3 const &position, float half_volume_radius) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, volume, position, half_volume_radius, false);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
+//helper: make an AddVoice command with the given playback parameters (the caller fills in the sample or stream):
+Command add_voice_command(float volume, float pan, glm::vec3 const &position, float half_volume_radius, bool loop) {
+	Command command;
+	command.type = Command::AddVoice;
+	command.loop = loop;
+	command.volume = volume;
+	command.pan = pan;
+	command.value = position;
+	command.half_volume_radius = half_volume_radius;
+	return command;
 }
 
-std::shared_ptr< Sound::PlayingSample > Sound::loop(Sample const &sample, float volume, float pan) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, volume, pan, true);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
+//helper: reserve a voice slot and queue an AddVoice command:
+Sound::PlayingSample start_voice(Command &&command) {
+	assert(command.type == Command::AddVoice);
+	assert((command.sample != nullptr) != (command.stream != nullptr));
+
+	//recover slots from voices that have finished:
+	Sound::collect();
+
+	if (command.sample && command.sample->size() == 0) return Sound::PlayingSample(); //nothing to play
+	if (free_slots.empty()) {
+		//(shouldn't happen; see MAX_SLOTS)
+		static bool warned = false;
+		if (!warned) {
+			std::cerr << "WARNING: all " << MAX_SLOTS << " voice slots are in use; ignoring play requests until some finish." << std::endl;
+			warned = true;
+		}
+		return Sound::PlayingSample();
+	}
+
+	Sound::PlayingSample playing_sample;
+	playing_sample.slot = free_slots.back();
+	playing_sample.generation = slot_generation[playing_sample.slot].load(std::memory_order_relaxed);
+	free_slots.pop_back();
+
+	command.slot = playing_sample.slot;
+	command.generation = playing_sample.generation;
+	send_command(std::move(command));
+
 	return playing_sample;
 }
 
+//2D voices have a NaN position; 3D voices have a NaN pan:
+static glm::vec3 const NoPosition = glm::vec3(std::numeric_limits< float >::quiet_NaN());
+static float const NoPan = std::numeric_limits< float >::quiet_NaN();
+
+double Sound::audio_time() {
+	return double(mixed_samples.load(std::memory_order_acquire)) / double(AUDIO_RATE);
+}
+
+//helper: convert an audio clock time to a start sample for an AddVoice command:
+static uint64_t start_sample_at(double time) {
+	if (!(time > 0.0)) return 0; //(also catches NaN)
+	return uint64_t(std::llround(time * double(AUDIO_RATE)));
+}
 
+Sound::PlayingSample Sound::play_at(Sample const &sample, double time, float volume, float pan) {
+	Command command = add_voice_command(volume, pan, NoPosition, NoPan, false);
+	command.sample = &sample;
+	command.start_sample = start_sample_at(time);
+	return start_voice(std::move(command));
+}
 
-std::shared_ptr< Sound::PlayingSample > Sound::loop_3D(Sample const &sample, float volume, glm::vec3 const &position, float half_volume_radius) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, volume, position, half_volume_radius, true);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
+Sound::PlayingSample Sound::play_3D_at(Sample const &sample, double time, float volume, glm::vec3 const &position, float half_volume_radius) {
+	Command command = add_voice_command(volume, NoPan, position, half_volume_radius, false);
+	command.sample = &sample;
+	command.start_sample = start_sample_at(time);
+	return start_voice(std::move(command));
+}
+
+Sound::PlayingSample Sound::loop_at(Sample const &sample, double time, float volume, float pan) {
+	Command command = add_voice_command(volume, pan, NoPosition, NoPan, true);
+	command.sample = &sample;
+	command.start_sample = start_sample_at(time);
+	return start_voice(std::move(command));
+}
+
+Sound::PlayingSample Sound::loop_3D_at(Sample const &sample, double time, float volume, glm::vec3 const &position, float half_volume_radius) {
+	Command command = add_voice_command(volume, NoPan, position, half_volume_radius, true);
+	command.sample = &sample;
+	command.start_sample = start_sample_at(time);
+	return start_voice(std::move(command));
+}
+
+Sound::PlayingSample Sound::play(Sample const &sample, float volume, float pan) {
+	Command command = add_voice_command(volume, pan, NoPosition, NoPan, false);
+	command.sample = &sample;
+	return start_voice(std::move(command));
+}
+
+Sound::PlayingSample Sound::play_3D(Sample const &sample, float volume, glm::vec3 const &position, float half_volume_radius) {
+	Command command = add_voice_command(volume, NoPan, position, half_volume_radius, false);
+	command.sample = &sample;
+	return start_voice(std::move(command));
+}
+
+Sound::PlayingSample Sound::loop(Sample const &sample, float volume, float pan) {
+	Command command = add_voice_command(volume, pan, NoPosition, NoPan, true);
+	command.sample = &sample;
+	return start_voice(std::move(command));
+}
+
+Sound::PlayingSample Sound::loop_3D(Sample const &sample, float volume, glm::vec3 const &position, float half_volume_radius) {
+	Command command = add_voice_command(volume, NoPan, position, half_volume_radius, true);
+	command.sample = &sample;
+	return start_voice(std::move(command));
+}
+
+Sound::PlayingSample Sound::play(StreamSample const &stream, float volume, float pan) {
+	Command command = add_voice_command(volume, pan, NoPosition, NoPan, false);
+	command.stream = stream.stream.get();
+	command.stream_restart = command.stream->restart(false);
+	return start_voice(std::move(command));
+}
+
+Sound::PlayingSample Sound::play_3D(StreamSample const &stream, float volume, glm::vec3 const &position, float half_volume_radius) {
+	Command command = add_voice_command(volume, NoPan, position, half_volume_radius, false);
+	command.stream = stream.stream.get();
+	command.stream_restart = command.stream->restart(false);
+	return start_voice(std::move(command));
+}
+
+Sound::PlayingSample Sound::loop(StreamSample const &stream, float volume, float pan) {
+	Command command = add_voice_command(volume, pan, NoPosition, NoPan, true);
+	command.stream = stream.stream.get();
+	command.stream_restart = command.stream->restart(true);
+	return start_voice(std::move(command));
+}
+
+Sound::PlayingSample Sound::loop_3D(StreamSample const &stream, float volume, glm::vec3 const &position, float half_volume_radius) {
+	Command command = add_voice_command(volume, NoPan, position, half_volume_radius, true);
+	command.stream = stream.stream.get();
+	command.stream_restart = command.stream->restart(true);
+	return start_voice(std::move(command));
 }
 
 
 void Sound::stop_all_samples() {
-	lock();
-	for (auto &s : playing_samples) {
-		s->stop();
-	}
-	unlock();
+	Command command;
+	command.type = Command::StopAll;
+	command.ramp = 1.0f / 60.0f;
+	send_command(std::move(command));
 }
 
 void Sound::set_volume(float new_volume, float ramp) {
-	lock();
-	volume.set(new_volume, ramp);
-	unlock();
+	Command command;
+	command.type = Command::SetGlobalVolume;
+	command.value.x = new_volume;
+	command.ramp = ramp;
+	send_command(std::move(command));
 }
 
-//------------------
+Sound::Stats Sound::get_stats() {
+	Stats ret;
+	ret.callbacks = stats.callbacks.load(std::memory_order_relaxed);
+	for (uint32_t i = 0; i < Stats::DurationBuckets; ++i) {
+		ret.duration_histogram[i] = stats.duration_histogram[i].load(std::memory_order_relaxed);
+	}
+	ret.budget_used = stats.budget_used.load(std::memory_order_relaxed);
+	ret.peak_budget_used = stats.peak_budget_used.load(std::memory_order_relaxed);
+	ret.late_callbacks = stats.late_callbacks.load(std::memory_order_relaxed);
+	ret.voices = stats.voices.load(std::memory_order_relaxed);
+	ret.real_voices = stats.real_voices.load(std::memory_order_relaxed);
+	ret.peak_voices = stats.peak_voices.load(std::memory_order_relaxed);
+	ret.voices_added = stats.voices_added.load(std::memory_order_relaxed);
+	ret.voices_removed = stats.voices_removed.load(std::memory_order_relaxed);
+	ret.voices_rejected = stats.voices_rejected.load(std::memory_order_relaxed);
+	ret.voices_stolen = stats.voices_stolen.load(std::memory_order_relaxed);
+	ret.voices_added_per_second = stats.voices_added_per_second.load(std::memory_order_relaxed);
+	ret.voices_removed_per_second = stats.voices_removed_per_second.load(std::memory_order_relaxed);
+	return ret;
+}
 
-void Sound::PlayingSample::set_volume(float new_volume, float ramp) {
-	Sound::lock();
-	if (!stopping) {
-		volume.set(new_volume, ramp);
+void Sound::set_voice_capacity(uint32_t capacity, VoiceOverflow overflow) {
+	if (capacity == 0 || capacity > MaxVoices) {
+		std::cerr << "WARNING: voice capacity " << capacity << " isn't between 1 and " << MaxVoices << "; using " << MaxVoices << "." << std::endl;
+		capacity = MaxVoices;
 	}
-	Sound::unlock();
+	Command command;
+	command.type = Command::SetVoiceCapacity;
+	command.slot = capacity;
+	command.generation = overflow;
+	send_command(std::move(command));
 }
 
-void Sound::PlayingSample::set_pan(float new_pan, float ramp) {
-	if (!(pan.value == pan.value)) return; //ignore if not in '2D' mode
-	Sound::lock();
-	pan.set(new_pan, ramp);
-	Sound::unlock();
+void Sound::set_reverb(std::vector< float > const &impulse_left, std::vector< float > const &impulse_right) {
+	Command command;
+	command.type = Command::SetReverb;
+	command.slot = next_reverb_id++;
+	if (!impulse_left.empty() || !impulse_right.empty()) {
+		reverbs.emplace_back(command.slot, std::make_unique< ConvolutionReverb >(impulse_left, impulse_right, mix_samples));
+		command.reverb = reverbs.back().second.get();
+	}
+	send_command(std::move(command));
 }
 
-void Sound::PlayingSample::set_position(glm::vec3 const &new_position, float ramp) {
-	if (pan.value == pan.value) return; //ignore if not in '3D' mode
-	Sound::lock();
-	position.set(new_position, ramp);
-	Sound::unlock();
+void Sound::make_reverb_impulse(float decay_seconds, std::vector< float > *impulse_left, std::vector< float > *impulse_right) {
+	assert(impulse_left);
+	assert(impulse_right);
+	decay_seconds = std::max(decay_seconds, 0.01f);
+	uint32_t length = uint32_t(std::ceil(decay_seconds * AUDIO_RATE));
+	impulse_left->resize(length);
+	impulse_right->resize(length);
+
+	//-60dB at decay_seconds, with a short fade-in so the onset isn't a click:
+	float decay = std::log(1000.0f) / (decay_seconds * AUDIO_RATE);
+	float fade_in = 0.005f * AUDIO_RATE;
+	//scaled so the impulse's energy is about one (so a full send is about as loud as the dry sound):
+	// (uniform noise has variance 1/3, and the envelope squared sums to about 1 / (2 * decay))
+	float scale = std::sqrt(6.0f * decay);
+
+	uint32_t seed = 0x12345678;
+	auto noise = [&seed]() {
+		//xorshift, mapped to [-1,1):
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+		return float(seed) * (2.0f / 4294967296.0f) - 1.0f;
+	};
+	for (uint32_t i = 0; i < length; ++i) {
+		float envelope = scale * std::exp(-decay * float(i)) * std::min(1.0f, float(i) / fade_in);
+		(*impulse_left)[i] = envelope * noise();
+		(*impulse_right)[i] = envelope * noise();
+	}
 }
 
-void Sound::PlayingSample::set_half_volume_radius(float new_radius, float ramp) {
-	if (pan.value == pan.value) return; //ignore if not in '3D' mode
-	Sound::lock();
-	half_volume_radius.set(new_radius, ramp);
-	Sound::unlock();
+void Sound::set_voice_limits(uint32_t max_real_voices, float audible_threshold) {
+	Command command;
+	command.type = Command::SetVoiceLimits;
+	command.slot = std::min(max_real_voices, MaxVoices);
+	command.value.x = audible_threshold;
+	send_command(std::move(command));
 }
 
-void Sound::PlayingSample::stop(float ramp) {
-	Sound::lock();
-	if (!(stopping || stopped)) {
-		stopping = true;
-		volume.target = 0.0f;
-		volume.ramp = ramp;
-	} else {
-		volume.ramp = std::min(volume.ramp, ramp);
-	}
-	Sound::unlock();
+//------------------
+
+void Sound::PlayingSample::set_volume(float new_volume, float ramp) const {
+	Command command;
+	command.type = Command::SetVolume;
+	command.slot = slot;
+	command.generation = generation;
+	command.value.x = new_volume;
+	command.ramp = ramp;
+	send_command(std::move(command));
+}
+
+void Sound::PlayingSample::set_pan(float new_pan, float ramp) const {
+	Command command;
+	command.type = Command::SetPan;
+	command.slot = slot;
+	command.generation = generation;
+	command.value.x = new_pan;
+	command.ramp = ramp;
+	send_command(std::move(command));
+}
+
+void Sound::PlayingSample::set_position(glm::vec3 const &new_position, float ramp) const {
+	Command command;
+	command.type = Command::SetPosition;
+	command.slot = slot;
+	command.generation = generation;
+	command.value = new_position;
+	command.ramp = ramp;
+	send_command(std::move(command));
+}
+
+void Sound::PlayingSample::set_half_volume_radius(float new_radius, float ramp) const {
+	Command command;
+	command.type = Command::SetHalfVolumeRadius;
+	command.slot = slot;
+	command.generation = generation;
+	command.value.x = new_radius;
+	command.ramp = ramp;
+	send_command(std::move(command));
+}
+
+void Sound::PlayingSample::set_priority(float new_priority) const {
+	Command command;
+	command.type = Command::SetPriority;
+	command.slot = slot;
+	command.generation = generation;
+	command.value.x = new_priority;
+	send_command(std::move(command));
+}
+
+void Sound::PlayingSample::set_reverb_send(float new_level, float ramp) const {
+	Command command;
+	command.type = Command::SetReverbSend;
+	command.slot = slot;
+	command.generation = generation;
+	command.value.x = new_level;
+	command.ramp = ramp;
+	send_command(std::move(command));
+}
+
+void Sound::PlayingSample::stop(float ramp) const {
+	Command command;
+	command.type = Command::Stop;
+	command.slot = slot;
+	command.generation = generation;
+	command.ramp = ramp;
+	send_command(std::move(command));
+}
+
+bool Sound::PlayingSample::stopped() const {
+	if (slot >= MAX_SLOTS) return true;
+	return slot_generation[slot].load(std::memory_order_acquire) != generation;
 }
 
 //------------------
 
 void Sound::Listener::set_position_right(glm::vec3 const &new_position, glm::vec3 const &new_right, float ramp) {
-	Sound::lock();
-	position.set(new_position, ramp);
+	Command command;
+	command.type = Command::SetListener;
+	command.value = new_position;
 	//some extra code to make sure right is always a unit vector:
 	if (new_right == glm::vec3(0.0f)) {
-		right.set(glm::vec3(1.0f, 0.0f, 0.0f), ramp);
+		command.value2 = glm::vec3(1.0f, 0.0f, 0.0f);
 	} else {
-		right.set(glm::normalize(new_right), ramp);
+		command.value2 = glm::normalize(new_right);
 	}
-	Sound::unlock();
+	command.ramp = ramp;
+	send_command(std::move(command));
 }
 
 //------------------------ internals --------------------------------
 
+//helper: stop a playing voice by fading it out over 'ramp' seconds:
+void stop_voice(uint32_t v, float ramp) {
+	if (!(voices.flags[v] & Voices::Stopping)) {
+		voices.flags[v] |= Voices::Stopping;
+		assert(playing_voices > 0);
+		--playing_voices;
+		voices.volume[v].target = 0.0f;
+		voices.volume[v].ramp = ramp;
+	} else {
+		voices.volume[v].ramp = std::min(voices.volume[v].ramp, ramp);
+	}
+}
+
+//helper: invalidate handles to a slot whose voice never started, and hand it back to the game thread:
+void reject_slot(uint32_t slot) {
+	assert(slot_voice[slot] == -1U);
+	slot_generation[slot].fetch_add(1, std::memory_order_release);
+	bool pushed = retired_slots.push(std::move(slot));
+	assert(pushed && "retired slot queue has room for every slot");
+	(void)pushed;
+	stats.voices_rejected.fetch_add(1, std::memory_order_relaxed);
+}
+
+//helper: pick a voice to make room for a new one according to voice_overflow (or -1U if there's nothing to steal):
+// 'stopping' says whether to look at voices that are already stopping or at ones that aren't
+uint32_t pick_stolen_voice(bool stopping) {
+	uint32_t best = -1U;
+	for (uint32_t v = 0; v < voices.count; ++v) {
+		if (bool(voices.flags[v] & Voices::Stopping) != stopping) continue;
+		if (best == -1U
+		 || (voice_overflow == Sound::StealOldest && voices.started[v] < voices.started[best])
+		 || (voice_overflow == Sound::StealQuietest && voice_score[v] < voice_score[best])) {
+			best = v;
+		}
+	}
+	return best;
+}
+
+//helper: make room for a new voice if the table is at capacity; returns false if the new voice should be rejected:
+bool make_room_for_voice() {
+	bool over_capacity = (playing_voices >= voice_capacity);
+	bool table_full = (voices.count == Sound::MaxVoices);
+	if (!over_capacity && !table_full) return true;
+	if (voice_overflow == Sound::RejectNew) return false;
+
+	if (over_capacity) {
+		//fade out a playing voice (over one block, to avoid a click):
+		uint32_t v = pick_stolen_voice(false);
+		if (v == -1U) return false;
+		stop_voice(v, block_time);
+		stats.voices_stolen.fetch_add(1, std::memory_order_relaxed);
+	}
+	if (voices.count == Sound::MaxVoices) {
+		//no room in the table even for voices that are fading out, so cut one off now (preferably one already stopping):
+		uint32_t v = pick_stolen_voice(true);
+		if (v == -1U) v = pick_stolen_voice(false);
+		if (v == -1U) return false;
+		if (!(voices.flags[v] & Voices::Stopping)) stats.voices_stolen.fetch_add(1, std::memory_order_relaxed);
+		retire_voice(v);
+	}
+	return true;
+}
+
+//apply one command to the mixer state:
+// (called by the audio callback, or while the audio device is locked)
+void apply_command(Command const &command) {
+	if (command.type == Command::AddVoice) {
+		if (command.stream) {
+			//a stream only plays in one voice at a time, so stop whichever voice was playing it:
+			if (command.stream->mixer_slot != -1U) {
+				retire_voice(slot_voice[command.stream->mixer_slot]);
+			}
+		}
+
+		//apply the overflow policy if there are already too many voices:
+		if (!make_room_for_voice()) {
+			reject_slot(command.slot);
+			return;
+		}
+
+		if (command.stream) {
+			command.stream->mixer_slot = command.slot;
+			command.stream->mixer_restart = command.stream_restart;
+			command.stream->mixer_synced = false;
+		}
+
+		assert(voices.count < Sound::MaxVoices); //(make_room_for_voice made sure)
+		assert(slot_voice[command.slot] == -1U);
+		uint32_t v = voices.count;
+		++voices.count;
+		voices.data[v] = nullptr;
+		voices.encoding[v] = Sound::Sample::Float;
+		if (command.sample) {
+			Sound::Sample const &sample = *command.sample;
+			voices.encoding[v] = sample.encoding;
+			if (sample.encoding == Sound::Sample::Int16) voices.data[v] = sample.data_int16.data();
+			else if (sample.encoding == Sound::Sample::ADPCM) voices.data[v] = sample.data_adpcm.data();
+			else voices.data[v] = sample.samples();
+		}
+		voices.length[v] = (command.sample ? uint32_t(command.sample->size()) : 0);
+		voices.cursor[v] = 0;
+		voices.adpcm[v] = ADPCMPosition();
+		voices.stream[v] = command.stream;
+		voices.flags[v] = (command.loop ? Voices::Loop : 0) | Voices::Real; //(starts out "real" so it doesn't fade in)
+		voices.priority[v] = 1.0f;
+		voices.started[v] = voices_started++;
+		voices.start_sample[v] = command.start_sample;
+		voice_score[v] = std::numeric_limits< float >::infinity(); //(not heard yet, so don't steal it for being quiet)
+		voices.volume[v].set(command.volume, 0.0f);
+		voices.pan[v].set(command.pan, 0.0f);
+		voices.position[v].set(command.value, 0.0f);
+		voices.half_volume_radius[v].set(command.half_volume_radius, 0.0f);
+		voices.reverb_send[v].set(0.0f, 0.0f);
+		voices.slot[v] = command.slot;
+		slot_voice[command.slot] = v;
+		++playing_voices;
+		stats.voices_added.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	//look up the voice for per-voice commands (-1U if the handle has gone stale):
+	uint32_t v = -1U;
+	if (command.slot < MAX_SLOTS
+	 && slot_generation[command.slot].load(std::memory_order_relaxed) == command.generation) {
+		v = slot_voice[command.slot];
+	}
+	//2D voices have a non-NaN pan; 3D voices have a NaN pan:
+	bool is_2D = (v != -1U && voices.pan[v].value == voices.pan[v].value);
+
+	switch (command.type) {
+		case Command::AddVoice:
+			break; //(handled above)
+		case Command::SetVolume:
+			if (v != -1U && !(voices.flags[v] & Voices::Stopping)) {
+				voices.volume[v].set(command.value.x, command.ramp);
+			}
+			break;
+		case Command::SetPan:
+			if (v != -1U && is_2D) voices.pan[v].set(command.value.x, command.ramp); //ignore if not in '2D' mode
+			break;
+		case Command::SetPosition:
+			if (v != -1U && !is_2D) voices.position[v].set(command.value, command.ramp); //ignore if not in '3D' mode
+			break;
+		case Command::SetHalfVolumeRadius:
+			if (v != -1U && !is_2D) voices.half_volume_radius[v].set(command.value.x, command.ramp); //ignore if not in '3D' mode
+			break;
+		case Command::SetPriority:
+			if (v != -1U) voices.priority[v] = command.value.x;
+			break;
+		case Command::Stop:
+			if (v != -1U) stop_voice(v, command.ramp);
+			break;
+		case Command::StopAll:
+			for (uint32_t i = 0; i < voices.count; ++i) {
+				stop_voice(i, command.ramp);
+			}
+			break;
+		case Command::SetGlobalVolume:
+			Sound::volume.set(command.value.x, command.ramp);
+			break;
+		case Command::SetListener:
+			Sound::listener.position.set(command.value, command.ramp);
+			Sound::listener.right.set(command.value2, command.ramp);
+			break;
+		case Command::SetVoiceLimits:
+			max_real_voices = command.slot;
+			audible_threshold = command.value.x;
+			break;
+		case Command::SetVoiceCapacity:
+			voice_capacity = command.slot;
+			voice_overflow = Sound::VoiceOverflow(command.generation);
+			break;
+		case Command::SetReverbSend:
+			if (v != -1U) voices.reverb_send[v].set(command.value.x, command.ramp);
+			break;
+		case Command::SetReverb:
+			reverb = command.reverb;
+			reverb_in_use.store(command.slot, std::memory_order_release);
+			break;
+	}
+}
+
+//apply all queued commands:
+// (called by the audio callback, or while the audio device is locked)
+void drain_commands() {
+	Command command;
+	while (command_queue.pop(&command)) {
+		apply_command(command);
+	}
+}
+
+//queue a command for the audio callback:
+// (called from the game thread)
+void send_command(Command &&command) {
+	if (!command_queue.push(std::move(command))) {
+		//queue is full (callback stalled, or no audio device to drain it)
+		// so fall back to locking and doing the callback's work here:
+		Sound::lock();
+		drain_commands();
+		apply_command(command);
+		Sound::unlock();
+	}
+}
+
+//remove a finished voice from the table and hand its slot back to the game thread:
+// (called by the audio callback)
+void retire_voice(uint32_t v) {
+	assert(v < voices.count);
+	uint32_t slot = voices.slot[v];
+	if (voices.stream[v]) {
+		assert(voices.stream[v]->mixer_slot == slot);
+		voices.stream[v]->mixer_slot = -1U;
+	}
+	if (!(voices.flags[v] & Voices::Stopping)) {
+		assert(playing_voices > 0);
+		--playing_voices;
+	}
+
+	//swap-remove to keep the table dense:
+	uint32_t last = voices.count - 1;
+	if (v != last) {
+		voices.data[v] = voices.data[last];
+		voices.encoding[v] = voices.encoding[last];
+		voices.length[v] = voices.length[last];
+		voices.cursor[v] = voices.cursor[last];
+		voices.adpcm[v] = voices.adpcm[last];
+		voices.stream[v] = voices.stream[last];
+		voices.flags[v] = voices.flags[last];
+		voices.priority[v] = voices.priority[last];
+		voices.started[v] = voices.started[last];
+		voices.start_sample[v] = voices.start_sample[last];
+		voice_score[v] = voice_score[last];
+		voices.volume[v] = voices.volume[last];
+		voices.pan[v] = voices.pan[last];
+		voices.position[v] = voices.position[last];
+		voices.half_volume_radius[v] = voices.half_volume_radius[last];
+		voices.reverb_send[v] = voices.reverb_send[last];
+		voices.slot[v] = voices.slot[last];
+		slot_voice[voices.slot[v]] = v;
+	}
+	voices.count = last;
+
+	stats.voices_removed.fetch_add(1, std::memory_order_relaxed);
+
+	//invalidate handles to this slot, then recycle it:
+	slot_voice[slot] = -1U;
+	slot_generation[slot].fetch_add(1, std::memory_order_release);
+	bool pushed = retired_slots.push(std::move(slot));
+	assert(pushed && "retired slot queue has room for every slot");
+	(void)pushed;
+}
+
 
 //helper: equal-power panning
 inline void compute_pan_weights(float pan, float *left, float *right) {
@@ -219,66 +1226,33 @@ inline void compute_pan_weights(float pan, float *left, float *right) {
 	*right = std::sin(ang);
 }
 
-//helper: 3D audio panning
-void compute_pan_from_listener_and_position(
-	glm::vec3 const &listener_position,
-	glm::vec3 const &listener_right,
-	glm::vec3 const &source_position,
-	float source_half_radius,
-	float *left, float *right
-	) {
-	glm::vec3 to = source_position - listener_position;
-	float distance = glm::length(to);
-	//start by panning based on direction.
-	//note that for a LR fade to sound uniform, sound power (squared magnitude) should remain constant.
-	if (distance == 0.0f) {
-		*left = *right = std::sqrt(2.0f);
-	} else {
-		//amt ranges from -1 (most left) to 1 (most right):
-		float amt = glm::dot(listener_right, to) / distance;
-		//turn into an angle from 0.0f (most left) to pi/2 (most right):
-		float ang = 0.5f * 3.1415926f * (0.5f * (amt + 1.0f));
-		*left = std::cos(ang);
-		*right = std::sin(ang);
-
-		//squared distance attenuation is realistic if there are no walls,
-		// but I'm going to use linear because it's sounds better to me.
-		// (feel free to change it, of course)
-		//want att = 0.5f at distance == half_volume_radius
-		float att = 1.0f / (1.0f + (distance / source_half_radius));
-		*left *= att;
-		*right *= att;
-	}
-}
-
-//helper: ramp updates...
-constexpr float const RAMP_STEP = float(MIX_SAMPLES) / float(AUDIO_RATE);
+//helper: ramp updates (moving 'dt' seconds along the ramp, so results don't depend on block size)...
 
 //helper: ...for single values:
-void step_value_ramp(Sound::Ramp< float > &ramp) {
-	if (ramp.ramp < RAMP_STEP) {
+void step_value_ramp(Sound::Ramp< float > &ramp, float dt) {
+	if (ramp.ramp < dt) {
 		ramp.value = ramp.target;
 		ramp.ramp = 0.0f;
 	} else {
-		ramp.value += (RAMP_STEP / ramp.ramp) * (ramp.target - ramp.value);
-		ramp.ramp -= RAMP_STEP;
+		ramp.value += (dt / ramp.ramp) * (ramp.target - ramp.value);
+		ramp.ramp -= dt;
 	}
 }
 
 //helper: ...for 3D positions:
-void step_position_ramp(Sound::Ramp< glm::vec3 > &ramp) {
-	if (ramp.ramp < RAMP_STEP) {
+void step_position_ramp(Sound::Ramp< glm::vec3 > &ramp, float dt) {
+	if (ramp.ramp < dt) {
 		ramp.value = ramp.target;
 		ramp.ramp = 0.0f;
 	} else {
-		ramp.value = glm::mix(ramp.value, ramp.target, RAMP_STEP / ramp.ramp);
-		ramp.ramp -= RAMP_STEP;
+		ramp.value = glm::mix(ramp.value, ramp.target, dt / ramp.ramp);
+		ramp.ramp -= dt;
 	}
 }
 
 //helper: ...for 3D directions:
-void step_direction_ramp(Sound::Ramp< glm::vec3 > &ramp) {
-	if (ramp.ramp < RAMP_STEP) {
+void step_direction_ramp(Sound::Ramp< glm::vec3 > &ramp, float dt) {
+	if (ramp.ramp < dt) {
 		ramp.value = ramp.target;
 		ramp.ramp = 0.0f;
 	} else {
@@ -302,13 +1276,378 @@ void step_direction_ramp(Sound::Ramp< glm::vec3 > &ramp) {
 		float angle = std::acos(glm::clamp(glm::dot(ramp.value, ramp.target), -1.0f, 1.0f));
 
 		//figure out new target value by moving angle toward target:
-		angle *= (ramp.ramp - RAMP_STEP) / ramp.ramp;
+		angle *= (ramp.ramp - dt) / ramp.ramp;
 
 		ramp.value = ramp.target * std::cos(angle) + perp * std::sin(angle);
-		ramp.ramp -= RAMP_STEP;
+		ramp.ramp -= dt;
+	}
+}
+
+
+//gains for mixing a run of samples: values at the first sample, and change per sample:
+struct RunGains {
+	float l, r;
+	float step_l, step_r;
+	RunGains at(uint32_t offset) const { return RunGains{ l + float(offset) * step_l, r + float(offset) * step_r, step_l, step_r }; }
+};
+
+//helper: mix 'count' samples starting at 'cursor' from sample data in any encoding into 'out' (and 'send', if not nullptr):
+// (like mix_mono_to_stereo, which is what it uses for Float data)
+// 'adpcm' tracks where ADPCM decoding stopped, so the next run can pick up from there
+void mix_sample_run(
+	float *out, float *send, void const *data, Sound::Sample::Encoding encoding, uint32_t cursor, uint32_t count,
+	RunGains const &gains, RunGains const &send_gains, ADPCMPosition *adpcm
+	) {
+	if (encoding == Sound::Sample::Int16) {
+		int16_t const *samples = static_cast< int16_t const * >(data) + cursor;
+		mix_int16_to_stereo(out, samples, count, gains.l, gains.r, gains.step_l, gains.step_r);
+		if (send) mix_int16_to_stereo(send, samples, count, send_gains.l, send_gains.r, send_gains.step_l, send_gains.step_r);
+	} else if (encoding == Sound::Sample::ADPCM) {
+		//decode up to four ADPCM blocks at a time (small enough to stay in cache), then mix (and send) them:
+		alignas(32) float decoded[4 * ADPCMBlockSamples];
+		for (uint32_t done = 0; done < count; /* later */) {
+			uint32_t at = cursor + done;
+			uint32_t run = std::min(count - done, 4 * ADPCMBlockSamples - at % ADPCMBlockSamples);
+			decode_adpcm(static_cast< uint8_t const * >(data), at, run, decoded, adpcm);
+			RunGains g = gains.at(done);
+			mix_mono_to_stereo(out + 2 * done, decoded, run, g.l, g.r, g.step_l, g.step_r);
+			if (send) {
+				RunGains s = send_gains.at(done);
+				mix_mono_to_stereo(send + 2 * done, decoded, run, s.l, s.r, s.step_l, s.step_r);
+			}
+			done += run;
+		}
+	} else {
+		float const *samples = static_cast< float const * >(data) + cursor;
+		mix_mono_to_stereo(out, samples, count, gains.l, gains.r, gains.step_l, gains.step_r);
+		if (send) mix_mono_to_stereo(send, samples, count, send_gains.l, send_gains.r, send_gains.step_l, send_gains.step_r);
 	}
 }
 
+//helper: is voice scheduled (with play_at()) to start after the block being mixed?
+// (such voices aren't heard, scored, or mixed, and their ramps stay put until they start)
+inline bool voice_waiting(uint32_t v) {
+	return voices.start_sample[v] >= block_start_sample + mix_samples;
+}
+
+//helper: mix one voice into 'out' (interleaved stereo, mix_samples frames) -- or just advance it, if it is virtual;
+// voices with a reverb send are also mixed into 'send' (same layout; nullptr if there is no reverb)
+// returns true if the voice has finished (and should be retired)
+// (called by the audio callback, or by a mixing thread; only touches this voice's state)
+bool mix_voice(uint32_t v, float *out, float *send) {
+	//voices scheduled with play_at() wait for a later block (and are retired right away if stopped while waiting)...
+	if (voice_waiting(v)) return (voices.flags[v] & Voices::Stopping);
+	//...or start partway through this one:
+	uint32_t offset = 0;
+	if (voices.start_sample[v] > block_start_sample) {
+		offset = uint32_t(voices.start_sample[v] - block_start_sample);
+		out += 2 * offset;
+		if (send) send += 2 * offset;
+	}
+	uint32_t frames = mix_samples - offset; //frames this voice plays this block
+
+	VoiceGains gains = voice_gains[v];
+	bool was_real = (voices.flags[v] & Voices::Real);
+	bool is_real = voice_selected[v];
+	if (is_real) {
+		voices.flags[v] |= Voices::Real;
+	} else {
+		voices.flags[v] &= ~Voices::Real;
+	}
+
+	//fade in voices becoming real, and mix voices becoming virtual for one more block to fade them out:
+	if (is_real && !was_real) {
+		gains.start_l = gains.start_r = 0.0f;
+	} else if (!is_real && was_real) {
+		gains.end_l = gains.end_r = 0.0f;
+	}
+	bool mix = (is_real || was_real);
+
+	//figure out a step to add at each sample so that pan will move smoothly from start to end:
+	float step_l = (gains.end_l - gains.start_l) / mix_samples;
+	float step_r = (gains.end_r - gains.start_r) / mix_samples;
+
+	//reverb send gains follow the voice's gains, scaled by its send level:
+	if (gains.send_start == 0.0f && gains.send_end == 0.0f) send = nullptr;
+	float send_start_l = gains.start_l * gains.send_start;
+	float send_start_r = gains.start_r * gains.send_start;
+	float send_step_l = (gains.end_l * gains.send_end - send_start_l) / mix_samples;
+	float send_step_r = (gains.end_r * gains.send_end - send_start_r) / mix_samples;
+	send_start_l += float(offset) * send_step_l;
+	send_start_r += float(offset) * send_step_r;
+
+	gains.start_l += float(offset) * step_l;
+	gains.start_r += float(offset) * step_r;
+
+	bool finished = false;
+	if (Sound::StreamSample::Stream *stream = voices.stream[v]) {
+		//streams play whatever has been decoded into their ring buffer:
+		if (!stream->mixer_synced && stream->restart_done.load(std::memory_order_acquire) == stream->mixer_restart) {
+			//the decoding thread has started this voice's restart, so skip to the start of it:
+			stream->read_pos.store(stream->restart_pos.load(std::memory_order_relaxed), std::memory_order_release);
+			stream->mixer_synced = true;
+		}
+		if (stream->mixer_synced) {
+			uint64_t read = stream->read_pos.load(std::memory_order_relaxed);
+			uint64_t available = stream->write_pos.load(std::memory_order_acquire) - read;
+			//if the stream has been restarted for another voice, samples from restart_pos on belong to that voice:
+			// (checked after loading write_pos: the decoding thread publishes a restart before writing any samples for it)
+			bool superseded = (stream->restart_done.load(std::memory_order_acquire) != stream->mixer_restart);
+			if (superseded) {
+				available = std::min(available, stream->restart_pos.load(std::memory_order_relaxed) - read);
+			}
+			uint32_t count = uint32_t(std::min< uint64_t >(frames, available));
+
+			//mix contiguous runs (up to the end of the ring, where it wraps):
+			for (uint32_t mixed = 0; mix && mixed < count; /* later */) {
+				uint32_t at = uint32_t((read + mixed) & (Sound::StreamSample::Stream::Capacity-1));
+				uint32_t run = std::min(count - mixed, Sound::StreamSample::Stream::Capacity - at);
+				mix_mono_to_stereo(
+					out + 2 * mixed, stream->ring.data() + at, run,
+					gains.start_l + float(mixed) * step_l, gains.start_r + float(mixed) * step_r,
+					step_l, step_r
+				);
+				if (send) {
+					mix_mono_to_stereo(
+						send + 2 * mixed, stream->ring.data() + at, run,
+						send_start_l + float(mixed) * send_step_l, send_start_r + float(mixed) * send_step_r,
+						send_step_l, send_step_r
+					);
+				}
+				mixed += run;
+			}
+			stream->read_pos.store(read + count, std::memory_order_release);
+
+			//if count < frames, either the stream is done or decoding fell behind (and the rest of this block is silent):
+			if (count < frames && !(voices.flags[v] & Voices::Loop)) {
+				finished = (read + count == stream->end_pos.load(std::memory_order_acquire));
+			}
+			if (superseded && count == available) finished = true;
+		}
+	} else if (mix) {
+		void const *data = voices.data[v];
+		Sound::Sample::Encoding encoding = voices.encoding[v];
+		uint32_t length = voices.length[v];
+		uint32_t &cursor = voices.cursor[v];
+		assert(cursor < length);
+
+		//mix contiguous runs of the sample (up to the end of the data, where it may wrap) in blocks:
+		for (uint32_t mixed = 0; mixed < frames; /* later */) {
+			uint32_t run = std::min(frames - mixed, length - cursor);
+			mix_sample_run(
+				out + 2 * mixed, (send ? send + 2 * mixed : nullptr), data, encoding, cursor, run,
+				RunGains{ gains.start_l, gains.start_r, step_l, step_r }.at(mixed),
+				RunGains{ send_start_l, send_start_r, send_step_l, send_step_r }.at(mixed),
+				&voices.adpcm[v]
+			);
+			mixed += run;
+
+			//update position in sample:
+			cursor += run;
+			if (cursor == length) {
+				if (voices.flags[v] & Voices::Loop) {
+					cursor = 0;
+				} else {
+					break;
+				}
+			}
+		}
+
+		finished = (cursor >= length);
+	} else {
+		//virtual voice: just advance position in sample
+		uint32_t length = voices.length[v];
+		uint32_t &cursor = voices.cursor[v];
+		uint64_t next = uint64_t(cursor) + frames;
+		if (next < length) {
+			cursor = uint32_t(next);
+		} else if (voices.flags[v] & Voices::Loop) {
+			cursor = uint32_t(next % length);
+		} else {
+			cursor = length;
+			finished = true;
+		}
+	}
+
+	return finished
+	    || ((voices.flags[v] & Voices::Stopping) && voices.volume[v].value == 0.0f);
+}
+
+//helper: mix voices [begin, end) into 'out' (and 'send'), noting which ones finished in voice_finished:
+void mix_voice_range(uint32_t begin, uint32_t end, float *out, float *send) {
+	for (uint32_t v = begin; v < end; ++v) {
+		voice_finished[v] = mix_voice(v, out, send);
+	}
+}
+
+//helper: mix one of the mixing pool's ranges into its scratch buffers:
+void mix_pool_range(MixPool::Range &range) {
+	float *send = nullptr;
+	std::fill(range.buffer.begin(), range.buffer.begin() + 2 * mix_samples, 0.0f);
+	if (mix_pool->sending) {
+		send = range.send_buffer.data();
+		std::fill(range.send_buffer.begin(), range.send_buffer.begin() + 2 * mix_samples, 0.0f);
+	}
+	mix_voice_range(range.begin, range.end, range.buffer.data(), send);
+}
+
+//mixing thread main loop:
+void mix_worker(MixPool *pool, MixPool::Worker *worker) {
+	for (;;) {
+		//claim and mix ranges until the current block has none left:
+		uint64_t work = pool->work.load(std::memory_order_acquire);
+		while ((work & 0xffff) < ((work >> 16) & 0xffff)) {
+			if (pool->work.compare_exchange_weak(work, work + 1, std::memory_order_acquire, std::memory_order_acquire)) {
+				mix_pool_range(*pool->ranges[(work & 0xffff) - 1]);
+				pool->done.fetch_add(1, std::memory_order_release);
+				work = pool->work.load(std::memory_order_acquire);
+			}
+		}
+		uint32_t seen = uint32_t(work >> 32);
+
+		//wait for the next block; spin briefly (blocks sometimes come in quick succession, e.g., from Sound::render), then park:
+		auto spin_end = std::chrono::steady_clock::now() + MIX_WORKER_SPIN;
+		for (uint32_t spin = 1; uint32_t(pool->work.load(std::memory_order_relaxed) >> 32) == seen; ++spin) {
+			if (pool->quit.load(std::memory_order_relaxed)) return;
+			spin_pause();
+			if (spin % 64 == 0 && std::chrono::steady_clock::now() > spin_end) {
+				//n.b. 'parked' store then 'work' load here, against 'work' store then 'parked' exchange in mix_voices:
+				// both sides need seq_cst so that at least one of them sees the other's store:
+				worker->parked.store(true, std::memory_order_seq_cst);
+				if (uint32_t(pool->work.load(std::memory_order_seq_cst) >> 32) == seen && !pool->quit.load(std::memory_order_seq_cst)) {
+					SDL_SemWait(worker->wake);
+				} else if (!worker->parked.exchange(false, std::memory_order_seq_cst)) {
+					//the callback saw 'parked' and posted anyway; take the post so the next park doesn't return early:
+					SDL_SemWait(worker->wake);
+				}
+				break;
+			}
+		}
+		if (pool->quit.load(std::memory_order_relaxed)) return;
+	}
+}
+
+//helper: start (or, with count == 0, stop) mixing threads:
+// (not called while the audio callback might be running)
+void set_mix_threads(uint32_t count) {
+	if (mix_pool) {
+		mix_pool->quit.store(true, std::memory_order_seq_cst);
+		for (auto &worker : mix_pool->workers) {
+			if (worker->parked.exchange(false, std::memory_order_seq_cst)) SDL_SemPost(worker->wake);
+		}
+		for (auto &worker : mix_pool->workers) {
+			worker->thread.join();
+			SDL_DestroySemaphore(worker->wake);
+		}
+		delete mix_pool;
+		mix_pool = nullptr;
+	}
+	if (count == 0) return;
+	count = std::min(count, uint32_t(Sound::MaxVoices / MIX_VOICES_PER_THREAD)); //(more could never be given ranges)
+
+	mix_pool = new MixPool;
+	mix_pool->workers.reserve(count);
+	mix_pool->ranges.reserve(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		mix_pool->workers.emplace_back(std::make_unique< MixPool::Worker >());
+		mix_pool->ranges.emplace_back(std::make_unique< MixPool::Range >());
+		mix_pool->workers.back()->wake = SDL_CreateSemaphore(0);
+		if (!mix_pool->workers.back()->wake) {
+			throw std::runtime_error("Failed to create mixing thread semaphore: " + std::string(SDL_GetError()));
+		}
+	}
+	for (auto &worker : mix_pool->workers) {
+		worker->thread = std::thread(mix_worker, mix_pool, worker.get());
+	}
+}
+
+//helper: mix all voices into 'out' (and reverb sends into 'send', if not nullptr), splitting them between mixing threads if worthwhile:
+void mix_voices(float *out, float *send) {
+	//count voices that will actually be mixed (virtual voices are nearly free):
+	uint32_t mixed_voices = 0;
+	for (uint32_t v = 0; v < voices.count; ++v) {
+		mixed_voices += (voice_selected[v] || (voices.flags[v] & Voices::Real)) ? 1 : 0;
+	}
+
+	uint32_t parts = 1;
+	if (mix_pool) {
+		parts = std::min(uint32_t(mix_pool->workers.size()) + 1, mixed_voices / MIX_VOICES_PER_THREAD);
+	}
+	if (parts <= 1) {
+		mix_voice_range(0, voices.count, out, send);
+		return;
+	}
+
+	//split voices into ranges with about the same number of mixed voices:
+	uint32_t ranges[2 * (Sound::MaxVoices / MIX_VOICES_PER_THREAD)];
+	assert(parts <= Sound::MaxVoices / MIX_VOICES_PER_THREAD);
+	{
+		uint32_t part = 0;
+		uint32_t seen = 0;
+		ranges[0] = 0;
+		for (uint32_t v = 0; v < voices.count && part + 1 < parts; ++v) {
+			seen += (voice_selected[v] || (voices.flags[v] & Voices::Real)) ? 1 : 0;
+			if (seen * parts >= (part + 1) * mixed_voices) {
+				ranges[2 * part + 1] = v + 1;
+				++part;
+				ranges[2 * part] = v + 1;
+			}
+		}
+		ranges[2 * part + 1] = voices.count;
+		parts = part + 1;
+	}
+
+	//publish ranges after the first, and wake parked workers (at most one per range):
+	for (uint32_t i = 1; i < parts; ++i) {
+		MixPool::Range &range = *mix_pool->ranges[i - 1];
+		range.begin = ranges[2 * i];
+		range.end = ranges[2 * i + 1];
+		range.in_out = false;
+	}
+	mix_pool->sending = (send != nullptr);
+	mix_pool->done.store(0, std::memory_order_relaxed);
+	uint64_t block = (mix_pool->work.load(std::memory_order_relaxed) >> 32) + 1;
+	//(seq_cst, pairing with the parking code in mix_worker)
+	mix_pool->work.store((block << 32) | (uint64_t(parts) << 16) | 1, std::memory_order_seq_cst);
+	uint32_t to_wake = parts - 1;
+	for (auto &worker : mix_pool->workers) {
+		if (to_wake == 0) break;
+		//(posting a semaphore doesn't block, so the callback never waits on a lock to get workers going)
+		if (worker->parked.exchange(false, std::memory_order_seq_cst)) {
+			SDL_SemPost(worker->wake);
+			--to_wake;
+		}
+	}
+
+	//mix the first range here:
+	mix_voice_range(ranges[0], ranges[1], out, send);
+
+	//then mix any ranges no worker has claimed yet (e.g., because they are still waking up) straight into the output:
+	uint32_t taken = 0;
+	uint64_t work = mix_pool->work.load(std::memory_order_relaxed);
+	while ((work & 0xffff) < parts) {
+		if (mix_pool->work.compare_exchange_weak(work, work + 1, std::memory_order_relaxed, std::memory_order_relaxed)) {
+			MixPool::Range &range = *mix_pool->ranges[(work & 0xffff) - 1];
+			mix_voice_range(range.begin, range.end, out, send);
+			range.in_out = true;
+			++taken;
+			work += 1;
+		}
+	}
+
+	//wait for ranges workers are partway through, and add their output:
+	//n.b. this is the one place the callback waits on the mixing threads -- it's short unless the OS preempts a worker
+	// mid-range, which is why mixing with threads isn't strictly real-time:
+	while (mix_pool->done.load(std::memory_order_acquire) != parts - 1 - taken) {
+		spin_pause();
+	}
+	for (uint32_t i = 1; i < parts; ++i) {
+		MixPool::Range const &range = *mix_pool->ranges[i - 1];
+		if (range.in_out) continue;
+		mix_add(out, range.buffer.data(), 2 * mix_samples);
+		if (send) mix_add(send, range.send_buffer.data(), 2 * mix_samples);
+	}
+}
 
 //The audio callback -- invoked by SDL when it needs more sound to play:
 void mix_audio(void *, Uint8 *buffer_, int len) {
@@ -319,11 +1658,25 @@ void mix_audio(void *, Uint8 *buffer_, int len) {
 		float r;
 	};
 	static_assert(sizeof(LR) == 8, "Sample is packed");
-	assert(len == MIX_SAMPLES * sizeof(LR)); //should always have the expected number of samples
+	assert(len == int(mix_samples * sizeof(LR))); //should always have the expected number of samples
 	LR *buffer = reinterpret_cast< LR * >(buffer_);
 
+	//check for callbacks that start late (playing to a device, the previous block should have just run out):
+	auto callback_start = std::chrono::steady_clock::now();
+	if (device != 0 && stats.callbacks.load(std::memory_order_relaxed) != 0) {
+		float interval = std::chrono::duration< float >(callback_start - stats_last_callback).count();
+		if (interval > 1.5f * block_time) {
+			stats.late_callbacks.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+	stats_last_callback = callback_start;
+
+	//pick up any changes made by the game thread since the last callback:
+	drain_commands();
+	block_start_sample = mixed_samples.load(std::memory_order_relaxed);
+
 	//zero the output buffer:
-	for (uint32_t s = 0; s < MIX_SAMPLES; ++s) {
+	for (uint32_t s = 0; s < mix_samples; ++s) {
 		buffer[s].l = 0.0f;
 		buffer[s].r = 0.0f;
 	}
@@ -333,106 +1686,191 @@ void mix_audio(void *, Uint8 *buffer_, int len) {
 	glm::vec3 start_position =  Sound::listener.position.value;
 	glm::vec3 start_right =  Sound::listener.right.value;
 
-	step_value_ramp(Sound::volume);
-	step_position_ramp( Sound::listener.position);
-	step_direction_ramp( Sound::listener.right);
+	step_value_ramp(Sound::volume, block_time);
+	step_position_ramp(Sound::listener.position, block_time);
+	step_direction_ramp(Sound::listener.right, block_time);
 
 	float end_volume = Sound::volume.value;
 	glm::vec3 end_position =  Sound::listener.position.value;
 	glm::vec3 end_right =  Sound::listener.right.value;
 
-	//add audio from each playing sample into the buffer:
-	for (auto si = playing_samples.begin(); si != playing_samples.end(); /* later */) {
-		Sound::PlayingSample &playing_sample = **si; //much more convenient than writing ** everywhere.
+	//figure out how loud each voice will be this block:
+	// 2D voices are panned as they go, while 3D voices are gathered up so they can be panned all at once:
+	uint32_t pan_count = 0;
+	for (uint32_t v = 0; v < voices.count; ++v) {
+		//convenient references to this voice's state:
+		Sound::Ramp< float > &volume = voices.volume[v];
+		Sound::Ramp< float > &pan = voices.pan[v];
+		Sound::Ramp< glm::vec3 > &position = voices.position[v];
+		Sound::Ramp< float > &half_volume_radius = voices.half_volume_radius[v];
+		bool is_2D = (pan.value == pan.value);
+		VoiceGains &gains = voice_gains[v];
+
+		if (voice_waiting(v)) {
+			gains = VoiceGains{ 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+			continue;
+		}
 
 		//Figure out sample panning/volume at start...
-		LR start_pan;
-		if (!(playing_sample.pan.value == playing_sample.pan.value)) {
-			//3D panning
-			compute_pan_from_listener_and_position(
-				start_position, start_right,
-				playing_sample.position.value,
-				playing_sample.half_volume_radius.value,
-				&start_pan.l, &start_pan.r);
-
-			step_position_ramp(playing_sample.position);
-			step_value_ramp(playing_sample.half_volume_radius);
+		if (!is_2D) {
+			//3D panning (just volume for now; pan_3d() fills in the rest below)
+			pan_voices[pan_count] = v;
+			pan_start.x[pan_count] = position.value.x;
+			pan_start.y[pan_count] = position.value.y;
+			pan_start.z[pan_count] = position.value.z;
+			pan_start.radius[pan_count] = half_volume_radius.value;
+
+			step_position_ramp(position, block_time);
+			step_value_ramp(half_volume_radius, block_time);
+
+			pan_end.x[pan_count] = position.value.x;
+			pan_end.y[pan_count] = position.value.y;
+			pan_end.z[pan_count] = position.value.z;
+			pan_end.radius[pan_count] = half_volume_radius.value;
+			++pan_count;
+
+			gains.start_l = gains.start_r = start_volume * volume.value;
+			step_value_ramp(volume, block_time);
+			gains.end_l = gains.end_r = end_volume * volume.value;
 		} else {
 			//2D panning
-			compute_pan_weights(playing_sample.pan.value, &start_pan.l, &start_pan.r);
+			compute_pan_weights(pan.value, &gains.start_l, &gains.start_r);
+			gains.start_l *= start_volume * volume.value;
+			gains.start_r *= start_volume * volume.value;
 
-			step_value_ramp(playing_sample.pan);
+			step_value_ramp(pan, block_time);
+			step_value_ramp(volume, block_time);
+
+			//..and end of the mix period:
+			compute_pan_weights(pan.value, &gains.end_l, &gains.end_r);
+			gains.end_l *= end_volume * volume.value;
+			gains.end_r *= end_volume * volume.value;
 		}
-		start_pan.l *= start_volume * playing_sample.volume.value;
-		start_pan.r *= start_volume * playing_sample.volume.value;
 
-		step_value_ramp(playing_sample.volume);
+		//reverb send level, relative to the gains:
+		Sound::Ramp< float > &reverb_send = voices.reverb_send[v];
+		gains.send_start = reverb_send.value;
+		step_value_ramp(reverb_send, block_time);
+		gains.send_end = reverb_send.value;
+	}
 
-		//..and end of the mix period:
-		LR end_pan;
-		if (!(playing_sample.pan.value == playing_sample.pan.value)) {
-			//3D panning
-			compute_pan_from_listener_and_position(
-				end_position, end_right,
-				playing_sample.position.value,
-				playing_sample.half_volume_radius.value,
-				&end_pan.l, &end_pan.r);
-		} else {
-			//2D panning
-			compute_pan_weights(playing_sample.pan.value, &end_pan.l, &end_pan.r);
+	//pan all 3D voices:
+	if (pan_count) {
+		PanListener listener_start{ { start_position.x, start_position.y, start_position.z }, { start_right.x, start_right.y, start_right.z } };
+		PanListener listener_end{ { end_position.x, end_position.y, end_position.z }, { end_right.x, end_right.y, end_right.z } };
+		pan_3d(listener_start, pan_start.x.data(), pan_start.y.data(), pan_start.z.data(), pan_start.radius.data(), pan_count, pan_start.left.data(), pan_start.right.data());
+		pan_3d(listener_end, pan_end.x.data(), pan_end.y.data(), pan_end.z.data(), pan_end.radius.data(), pan_count, pan_end.left.data(), pan_end.right.data());
+		for (uint32_t i = 0; i < pan_count; ++i) {
+			VoiceGains &gains = voice_gains[pan_voices[i]];
+			gains.start_l *= pan_start.left[i];
+			gains.start_r *= pan_start.right[i];
+			gains.end_l *= pan_end.left[i];
+			gains.end_r *= pan_end.right[i];
 		}
+	}
 
-		end_pan.l *= end_volume * playing_sample.volume.value;
-		end_pan.r *= end_volume * playing_sample.volume.value;
+	//score voices by loudness:
+	uint32_t audible_count = 0;
+	for (uint32_t v = 0; v < voices.count; ++v) {
+		voice_selected[v] = 0;
+		if (voice_waiting(v)) continue; //(keeps its "not heard yet" score)
+		VoiceGains const &gains = voice_gains[v];
+		float loudness = std::max(
+			std::max(std::abs(gains.start_l), std::abs(gains.start_r)),
+			std::max(std::abs(gains.end_l), std::abs(gains.end_r))
+		);
+		voice_score[v] = voices.priority[v] * loudness;
+		if (loudness >= audible_threshold) {
+			audible_voices[audible_count] = v;
+			++audible_count;
+		}
+	}
 
-		//figure out a step to add at each sample so that pan will move smoothly from start to end:
-		LR pan = start_pan;
-		LR pan_step;
-		pan_step.l = (end_pan.l - start_pan.l) / MIX_SAMPLES;
-		pan_step.r = (end_pan.r - start_pan.r) / MIX_SAMPLES;
+	//if over budget, keep only the highest-scoring voices real (the rest are "stolen" and go virtual):
+	if (audible_count > max_real_voices) {
+		std::nth_element(
+			audible_voices.begin(), audible_voices.begin() + max_real_voices, audible_voices.begin() + audible_count,
+			[](uint32_t a, uint32_t b) { return voice_score[a] > voice_score[b]; }
+		);
+		audible_count = max_real_voices;
+	}
+	for (uint32_t i = 0; i < audible_count; ++i) {
+		voice_selected[audible_voices[i]] = 1;
+	}
 
-		assert(playing_sample.i < playing_sample.data.size());
+	//add audio from each real voice into the buffer (and reverb sends into send_bus), and advance virtual voices:
+	// (the reverb was built for a particular block size, so it sits out if Sound::init has changed it since)
+	bool use_reverb = (reverb && reverb->block == mix_samples);
+	if (use_reverb) std::fill(send_bus.begin(), send_bus.begin() + 2 * mix_samples, 0.0f);
+	mix_voices(&buffer[0].l, use_reverb ? send_bus.data() : nullptr);
 
-		for (uint32_t i = 0; i < MIX_SAMPLES; ++i) {
-			//mix one sample based on current pan values:
-			buffer[i].l += pan.l * playing_sample.data[playing_sample.i];
-			buffer[i].r += pan.r * playing_sample.data[playing_sample.i];
+	//run the send bus through the reverb (mono in, stereo out):
+	if (use_reverb) {
+		for (uint32_t i = 0; i < mix_samples; ++i) {
+			reverb_input[i] = 0.5f * (send_bus[2 * i] + send_bus[2 * i + 1]);
+		}
+		reverb->process(reverb_input.data(), &buffer[0].l);
+	}
 
-			//update position in sample:
-			playing_sample.i += 1;
-			if (playing_sample.i == playing_sample.data.size()) {
-				if (playing_sample.loop) {
-					playing_sample.i = 0;
-				} else {
-					break;
-				}
-			}
+	uint32_t finished_count = 0;
+	for (uint32_t v = 0; v < voices.count; ++v) {
+		if (voice_finished[v]) {
+			finished_voices[finished_count] = v;
+			++finished_count;
+		}
+	}
+
+	//retire finished voices from the back, so swap-remove never moves a voice that is also finished:
+	for (uint32_t i = finished_count - 1; i < finished_count; --i) {
+		retire_voice(finished_voices[i]);
+	}
 
-			//update pan values:
-			pan.l += pan_step.l;
-			pan.r += pan_step.r;
+	//advance the audio clock:
+	mixed_samples.store(block_start_sample + mix_samples, std::memory_order_release);
+
+	//update statistics:
+	{
+		float duration = std::chrono::duration< float >(std::chrono::steady_clock::now() - callback_start).count();
+		uint32_t micros = uint32_t(std::min(duration * 1e6f, 1e9f));
+		uint32_t bucket = 0;
+		while (bucket + 1 < Sound::Stats::DurationBuckets && (micros >> (bucket + 1)) != 0) ++bucket;
+		stats.duration_histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+
+		float budget_used = duration / block_time;
+		stats.budget_used.store(budget_used, std::memory_order_relaxed);
+		if (budget_used > stats.peak_budget_used.load(std::memory_order_relaxed)) {
+			stats.peak_budget_used.store(budget_used, std::memory_order_relaxed);
 		}
 
-		if (playing_sample.i >= playing_sample.data.size()
-		 || (playing_sample.stopping && playing_sample.volume.value == 0.0f)) { //sample has finished
-		 	playing_sample.stopped = true;
-			//erase from list:
-			auto old = si;
-			++si;
-			playing_samples.erase(old);
-		} else {
-			++si;
+		uint32_t playing = voices.count + finished_count; //(including voices that finished during this callback)
+		stats.voices.store(playing, std::memory_order_relaxed);
+		stats.real_voices.store(audible_count, std::memory_order_relaxed);
+		if (playing > stats.peak_voices.load(std::memory_order_relaxed)) {
+			stats.peak_voices.store(playing, std::memory_order_relaxed);
 		}
+
+		//per-second rates, over (about) a second of audio:
+		stats_window_samples += mix_samples;
+		if (stats_window_samples >= AUDIO_RATE) {
+			float seconds = float(stats_window_samples) / float(AUDIO_RATE);
+			uint64_t added = stats.voices_added.load(std::memory_order_relaxed);
+			uint64_t removed = stats.voices_removed.load(std::memory_order_relaxed);
+			stats.voices_added_per_second.store(float(added - stats_window_added) / seconds, std::memory_order_relaxed);
+			stats.voices_removed_per_second.store(float(removed - stats_window_removed) / seconds, std::memory_order_relaxed);
+			stats_window_added = added;
+			stats_window_removed = removed;
+			stats_window_samples = 0;
+		}
+
+		stats.callbacks.fetch_add(1, std::memory_order_relaxed);
 	}
 
 	/*//DEBUG: report output power:
 	float max_power = 0.0f;
-	for (uint32_t s = 0; s < MIX_SAMPLES; ++s) {
+	for (uint32_t s = 0; s < mix_samples; ++s) {
 		max_power = std::max(max_power, (buffer[s].l * buffer[s].l + buffer[s].r * buffer[s].r));
 	}
-	std::cout << "Max Power: " << std::sqrt(max_power) << "; playing samples: " << playing_samples.size() << std::endl; //DEBUG
+	std::cout << "Max Power: " << std::sqrt(max_power) << "; playing voices: " << voices.count << "; real: " << audible_count << std::endl; //DEBUG
 	*/
 
 }
-
-
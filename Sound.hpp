@@ -10,19 +10,61 @@
 //Game audio system. Simplified from f18-base3.
 //Uses 48kHz sampling rate.
 
+struct PCMCacheFile; //(see pcm_cache.hpp)
+
 namespace Sound {
 
 //Sample objects hold mono (one-channel) audio.
 struct Sample {
+	//Sample data can be kept in memory in a few ways (the mixer decodes as it plays):
+	enum Encoding : uint8_t {
+		Float, //32-bit floating point (4 bytes per sample)
+		Int16, //16-bit integer (2 bytes per sample; good enough for nearly everything)
+		ADPCM, //4-bit IMA-ADPCM (~0.52 bytes per sample; adds a little hiss and costs more CPU to decode, so best for short sound effects)
+	};
+
 	//Load from a '.wav' or '.opus' file.
 	//  will warn and convert if sound is not already 48kHz mono:
-	Sample(std::string const &filename);
+	Sample(std::string const &filename, Encoding encoding = Float);
 	
 	//Directly supply an audio buffer:
-	Sample(std::vector< float > const &data);
+	Sample(std::vector< float > const &data, Encoding encoding = Float);
+
+	//sample data is 48kHz, mono:
+	Encoding encoding = Float;
+	size_t size() const; //number of samples
+	size_t bytes() const; //memory used by samples
+	float const *samples() const; //floating-point samples (nullptr unless encoding is Float)
 
-	//sample data is stored as 48kHz, mono, floating-point:
+	//Float samples are stored either here...
 	std::vector< float > data;
+	//...or, for '.opus' files that have been decoded before, in a memory-mapped cache (see pcm_cache.hpp):
+	std::shared_ptr< PCMCacheFile const > cache;
+	//Int16 samples are stored here:
+	std::vector< int16_t > data_int16;
+	//ADPCM samples are stored here (see adpcm.hpp):
+	std::vector< uint8_t > data_adpcm;
+	size_t adpcm_size = 0; //(number of samples in data_adpcm)
+};
+
+//StreamSample objects also hold mono audio, but decode it from an '.opus' file a bit at a time:
+// - a background thread keeps the file open and decodes a couple of seconds ahead of playback,
+//   so memory use doesn't depend on the length of the file (good for music)
+// - play them with the same play/loop/play_3D/loop_3D functions as Samples
+// - only one voice can play a given StreamSample at a time; playing it again restarts it from the beginning
+//   (and stops the voice that was playing it)
+// - a StreamSample must outlive any voices playing it (just like a Sample)
+struct StreamSample {
+	//Open an '.opus' file (throws on error):
+	StreamSample(std::string const &filename);
+	~StreamSample();
+
+	//internals (shared between the game thread, the decoding thread, and the audio callback):
+	struct Stream;
+	std::unique_ptr< Stream > stream;
+
+	StreamSample(StreamSample const &) = delete;
+	StreamSample &operator=(StreamSample const &) = delete;
 };
 
 //Ramp<> manages values that should be smoothly interpolated
@@ -48,60 +90,72 @@ struct Ramp {
 	float ramp = 0.0f;
 };
 
-// 'PlayingSample' objects book-keep samples that are currently playing:
+// 'PlayingSample' is a handle to a sample that is (or was) playing:
+// handles are small and cheap to copy; the voice they refer to lives in a fixed-size table
+// owned by the mixer, and the handle's 'generation' must match the table slot's generation
+// for the handle to be live. (So a handle safely goes stale once its voice finishes.)
 struct PlayingSample {
-	//change the panning or volume of a playing sample (and do proper locking);
+	//change the panning or volume of a playing sample (the change is queued for the audio callback);
 	// value will change over 'ramp' seconds to avoid creating audible artifacts:
-	void set_volume(float new_volume, float ramp = 1.0f / 60.0f);
+	void set_volume(float new_volume, float ramp = 1.0f / 60.0f) const;
 	//set the panning of a sample (use only on samples in "2D" mode; no effect on "3D" samples):
-	void set_pan(float new_pan, float ramp = 1.0f / 60.0f);
+	void set_pan(float new_pan, float ramp = 1.0f / 60.0f) const;
 	//set the position of a sample (use only on samples in "3D" mode; no effect on "2D" samples):
-	void set_position(glm::vec3 const &new_position, float ramp = 1.0f / 60.0f);
+	void set_position(glm::vec3 const &new_position, float ramp = 1.0f / 60.0f) const;
 	//set the half-volume radius (use only on "3D" playing sounds):
-	void set_half_volume_radius(float new_radius, float ramp = 1.0f / 60.0f);
+	void set_half_volume_radius(float new_radius, float ramp = 1.0f / 60.0f) const;
+
+	//when more voices are audible than the real voice budget allows (see Sound::set_voice_limits),
+	// voices with the lowest priority * loudness are silenced ("virtual") until there is room again.
+	// (all voices start with priority 1.0f)
+	void set_priority(float new_priority) const;
+
+	//send some of this sample to the reverb bus (see Sound::set_reverb); 0.0f (the default) sends nothing:
+	// (the send follows the sample's volume and panning, and is heard in addition to the dry sample)
+	void set_reverb_send(float new_level, float ramp = 1.0f / 60.0f) const;
 
 	//'stop' will fade sample out over 'ramp' seconds and then remove it from the active samples:
-	void stop(float ramp = 1.0f / 60.0f);
+	void stop(float ramp = 1.0f / 60.0f) const;
+
+	//was playback stopped (either by running out of sample, or by stop())?
+	// (also true for default-constructed handles and for play() calls that found no free voice)
+	bool stopped() const;
 
 	//internals:
-	//NOTE: PlayingSample is used in a separate thread; so setting these values directly
-	// may result in bad results. Instead, use the functions above, which perform locking!
-	std::vector< float > const &data; //reference to sample data being played
-	uint32_t i = 0; //next data value to read
-	bool loop = false; //should playback loop after data runs out?
-	bool stopping = false; //is playing stopping?
-	bool stopped = false; //was playback stopped (either by running out of sample, or by stop())?
-
-	Ramp< float > volume = Ramp< float >(1.0f);
-
-	//2D playback panning control: ('NaN' if sound played in 3D mode)
-	Ramp< float > pan = Ramp< float >(std::numeric_limits< float >::quiet_NaN());
-
-	//3D playback panning control: ('NaN' if sound played in 2D mode)
-	Ramp< glm::vec3 > position = Ramp< glm::vec3 >(std::numeric_limits< float >::quiet_NaN());
-	Ramp< float > half_volume_radius = std::numeric_limits< float >::quiet_NaN();
-
-	PlayingSample(Sample const &sample_, float volume_, float pan_, bool loop_)
-		: data(sample_.data), loop(loop_), volume(volume_), pan(pan_) { }
-	PlayingSample(Sample const &sample_, float volume_, glm::vec3 const &position_, float half_volume_radius_, bool loop_)
-		: data(sample_.data), loop(loop_), volume(volume_), position(position_), half_volume_radius(half_volume_radius_) { }
+	uint32_t slot = -1U; //index of voice slot in the mixer's table
+	uint32_t generation = 0; //generation of the slot when this voice was started
 };
 
 // ------- global functions -------
 
-void init(); //call Sound::init() from main.cpp before using any member functions
+//call Sound::init() from main.cpp before using any member functions:
+// audio is mixed in blocks of 'block_size' samples (a power of two, e.g. 128, 256, 512, 1024);
+// smaller blocks mean lower latency (1024 samples is ~21ms) but more CPU time spent per sample
+//'mix_threads' extra threads help mix when lots of voices are playing (worthwhile with thousands of voices);
+// n.b. the audio callback then waits on threads that are partway through their share, so it is no longer strictly real-time:
+void init(uint32_t block_size = 1024, uint32_t mix_threads = 0);
 
 void shutdown(); //call Sound::shutdown() from main.cpp to gracefully(-ish) exit
 
+//Sound::init_headless() sets up the mixer without opening an audio device (for tests, benchmarks, and offline rendering);
+// audio is then only produced by calling Sound::render():
+void init_headless(uint32_t block_size = 1024, uint32_t mix_threads = 0);
+
+//Mix the next 'frames' frames of 48kHz audio into 'stereo_out' (interleaved: l, r, l, r, ...; 2 * frames floats),
+// running the same mixing code as the audio callback and advancing playback, ramps, and streams by that many frames.
+//Output doesn't depend on how the frames are split between calls, so renders are repeatable.
+//Call from the game thread, and only after init_headless() (throws if an audio device is playing):
+void render(float *stereo_out, uint32_t frames);
+
 //Call 'Sound::play' to play a sample once.
 //  if you hang on to the return value, you can change the panning, volume, or stop playback early.
-std::shared_ptr< PlayingSample > play(
+PlayingSample play(
 	Sample const &sample,
 	float volume = 1.0f,
 	float pan = 0.0f //-1.0f == hard left, 1.0f == hard right
 );
 //The play_3D version will play a sample in '3D' mode (that is, panning determined by listener position):
-std::shared_ptr< PlayingSample > play_3D(
+PlayingSample play_3D(
 	Sample const &sample,
 	float volume,
 	glm::vec3 const &position,
@@ -110,19 +164,39 @@ std::shared_ptr< PlayingSample > play_3D(
 
 //Call 'Sound::loop' to play a sample ~forever~.
 //  if you hang on to the return value, you can change the panning, volume, or stop playback.
-std::shared_ptr< PlayingSample > loop(
+PlayingSample loop(
 	Sample const &sample,
 	float volume = 1.0f,
 	float pan = 0.0f //-1.0f == hard left, 1.0f == hard right
 );
 //The loop_3D version will loop a sample in '3D' mode (that is, panning determined by listener position):
-std::shared_ptr< PlayingSample > loop_3D(
+PlayingSample loop_3D(
 	Sample const &sample,
 	float volume,
 	glm::vec3 const &position,
 	float half_volume_radius = std::numeric_limits< float >::infinity()
 );
 
+//The StreamSample versions of the above functions work the same way:
+PlayingSample play(StreamSample const &stream, float volume = 1.0f, float pan = 0.0f);
+PlayingSample play_3D(StreamSample const &stream, float volume, glm::vec3 const &position, float half_volume_radius = std::numeric_limits< float >::infinity());
+PlayingSample loop(StreamSample const &stream, float volume = 1.0f, float pan = 0.0f);
+PlayingSample loop_3D(StreamSample const &stream, float volume, glm::vec3 const &position, float half_volume_radius = std::numeric_limits< float >::infinity());
+
+//The audio clock counts seconds of audio mixed since the mixer started (in whole blocks);
+// it is the time at which the next block to be mixed starts, so it never goes backward:
+double audio_time();
+
+//The '_at' versions of the play functions start playback at an exact time on the audio clock:
+// - the voice starts at the matching sample within its block, so scheduled sounds line up exactly
+// - times already in the past start as soon as possible (that is, in the next block mixed)
+// - to avoid that, schedule a little ahead: e.g., play_at(beat, Sound::audio_time() + 0.05)
+// - a scheduled voice counts as playing (for stopped(), set_voice_capacity, ...) while it waits
+PlayingSample play_at(Sample const &sample, double time, float volume = 1.0f, float pan = 0.0f);
+PlayingSample play_3D_at(Sample const &sample, double time, float volume, glm::vec3 const &position, float half_volume_radius = std::numeric_limits< float >::infinity());
+PlayingSample loop_at(Sample const &sample, double time, float volume = 1.0f, float pan = 0.0f);
+PlayingSample loop_3D_at(Sample const &sample, double time, float volume, glm::vec3 const &position, float half_volume_radius = std::numeric_limits< float >::infinity());
+
 //Listener controls the panning of "3D" samples (ones played using the "position" version of the play functions):
 struct Listener {
 	void set_position_right(glm::vec3 const &new_position, glm::vec3 const &new_right, float ramp = 1.0f / 60.0f);
@@ -140,9 +214,72 @@ void stop_all_samples();
 void set_volume(float new_volume, float ramp = 1.0f / 60.0f);
 extern Ramp< float > volume;
 
+//NOTE: the play/set_*/stop/... functions above are meant to be called from the game (main) thread only;
+// they pass their changes to the audio callback through a single-producer/single-consumer command queue.
+//At most MaxVoices samples can play at once (fewer if set_voice_capacity says so):
+constexpr uint32_t const MaxVoices = 4096;
+
+//What happens when a sample is played while 'capacity' voices are already playing:
+enum VoiceOverflow : uint8_t {
+	RejectNew, //the new sample doesn't play (its handle is already stopped); the default
+	StealQuietest, //the voice with the lowest priority * loudness fades out to make room (voices that haven't been heard yet are safe)
+	StealOldest, //the voice that started longest ago fades out to make room
+};
+//Limit the number of voices playing at once (between 1 and MaxVoices; voices fading out after stop() don't count):
+// n.b. playing, stopping, and stealing voices never allocates memory -- the voice table is allocated up front.
+void set_voice_capacity(uint32_t capacity, VoiceOverflow overflow = RejectNew);
+
+//Voices quieter than 'audible_threshold' (peak gain, after volume and distance attenuation) are "virtual":
+// they keep their place in the sample but cost (almost) nothing to mix, and become real again when they get louder.
+//At most 'max_real_voices' voices are mixed per block; the quietest/lowest priority voices beyond that go virtual.
+//(defaults are MaxVoices and 1e-4f -- that is, -80dB)
+void set_voice_limits(uint32_t max_real_voices, float audible_threshold = 1e-4f);
+
+//Reverb: samples with a reverb send (PlayingSample::set_reverb_send) are also mixed into a send bus,
+// which is mixed down to mono, convolved with a stereo impulse response (48kHz), and added to the output.
+// The convolution is done once per block for the whole bus (by partitioned FFT), so its cost depends on the
+// impulse length and block size but not on how many samples are sent to it -- a few seconds of impulse is fine.
+//Call after Sound::init (the reverb is built for its block size); empty impulse responses turn the reverb off.
+// (the new reverb replaces the old one at the start of a block; the old one is freed by a later Sound::collect())
+void set_reverb(std::vector< float > const &impulse_left, std::vector< float > const &impulse_right);
+//make a simple synthetic "room" impulse response: decorrelated noise in each channel that decays by 60dB over 'decay_seconds':
+void make_reverb_impulse(float decay_seconds, std::vector< float > *impulse_left, std::vector< float > *impulse_right);
+
+//Mixer statistics, for logging and debug overlays:
+// (gathered by the audio callback without locking; counts are since Sound::init())
+struct Stats {
+	uint64_t callbacks = 0; //number of blocks mixed
+	//callbacks by time taken: bucket i counts callbacks that took [2^i, 2^(i+1)) microseconds
+	// (bucket 0 also counts faster callbacks; the last bucket also counts slower ones)
+	static constexpr uint32_t const DurationBuckets = 16;
+	uint64_t duration_histogram[DurationBuckets] = { };
+	//time taken by callbacks, as a fraction of the time the block they mixed lasts (block size / 48000 s; e.g., 21.3ms for 1024):
+	float budget_used = 0.0f; //most recent callback
+	float peak_budget_used = 0.0f; //slowest callback
+	//callbacks that started well after the previous block should have run out -- that is, probable underruns:
+	// (only counted when playing to an audio device)
+	uint64_t late_callbacks = 0;
+	//voices:
+	uint32_t voices = 0; //playing during the most recent callback
+	uint32_t real_voices = 0; //...of which were mixed (not virtual)
+	uint32_t peak_voices = 0; //most playing at once
+	uint64_t voices_added = 0;
+	uint64_t voices_removed = 0;
+	uint64_t voices_rejected = 0; //play requests dropped because of the voice capacity (see set_voice_capacity)
+	uint64_t voices_stolen = 0; //voices stopped to make room for new ones
+	float voices_added_per_second = 0.0f; //over the most recent second of audio
+	float voices_removed_per_second = 0.0f;
+};
+Stats get_stats();
+
+//The audio callback never allocates or frees memory; when a voice finishes, it passes the voice's slot back to the game thread
+// through a lock-free queue, and Sound::collect() (called from main.cpp each frame, and by the play functions) reclaims them.
+//returns the number of slots reclaimed:
+uint32_t collect();
+
 //the audio callback doesn't run between Sound::lock() and Sound::unlock()
-// the set_*/stop/play/... functions already use these helpers, so you shouldn't need
-// to call them unless your code is modifying values directly:
+// none of the functions above need these anymore; they remain as an escape hatch
+// for code that modifies Sound::volume or Sound::listener directly:
 void lock();
 void unlock();
 
@@ -0,0 +1,195 @@
+#include "adpcm.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+
+//standard IMA-ADPCM tables:
+static int16_t const StepSizes[89] = {
+	7, 8, 9, 10, 11, 12, 13, 14, 16, 17,
+	19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+	50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+	130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+	337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+	876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+	2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
+	5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+	15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+static int8_t const IndexSteps[16] = {
+	-1, -1, -1, -1, 2, 4, 6, 8,
+	-1, -1, -1, -1, 2, 4, 6, 8
+};
+
+//the effect of each code at each step size, precomputed so decoding doesn't branch:
+// (decoding is a serial dependency chain through 'index', so keeping it to one table lookup matters)
+struct ADPCMStep {
+	int32_t diff; //change to predictor
+	int32_t index; //next step index
+};
+struct ADPCMSteps {
+	ADPCMStep steps[89][16];
+	ADPCMSteps() {
+		for (int32_t index = 0; index < 89; ++index) {
+			for (uint8_t code = 0; code < 16; ++code) {
+				int32_t step = StepSizes[index];
+				int32_t diff = step >> 3;
+				if (code & 4) diff += step;
+				if (code & 2) diff += step >> 1;
+				if (code & 1) diff += step >> 2;
+				steps[index][code].diff = (code & 8) ? -diff : diff;
+				steps[index][code].index = std::max(0, std::min(88, index + IndexSteps[code]));
+			}
+		}
+	}
+};
+static ADPCMSteps const &adpcm_steps() {
+	static ADPCMSteps const steps;
+	return steps;
+}
+
+//decoder state, shared by the encoder (which tracks what the decoder will reconstruct):
+struct ADPCMState {
+	int32_t predictor = 0;
+	int32_t index = 0;
+
+	//apply one 4-bit code:
+	inline void step(ADPCMSteps const &steps, uint8_t code) {
+		ADPCMStep const &s = steps.steps[index][code];
+		predictor = std::max(-32768, std::min(32767, predictor + s.diff));
+		index = s.index;
+	}
+};
+
+static int32_t quantize(float sample) {
+	return int32_t(std::max(-32768.0f, std::min(32767.0f, std::round(sample * 32768.0f))));
+}
+
+//helper: pick a starting step index that can keep up with the first few samples:
+// (starting from the smallest step would smear a sound that starts loud -- e.g., a drum hit -- over its first block
+//  while the step size grows)
+static int32_t initial_index(float const *samples, size_t count) {
+	int32_t largest = 0; //largest change between neighboring samples
+	int32_t previous = (count > 0 ? quantize(samples[0]) : 0);
+	for (size_t i = 1; i < std::min< size_t >(count, 8); ++i) {
+		int32_t current = quantize(samples[i]);
+		largest = std::max(largest, std::abs(current - previous));
+		previous = current;
+	}
+	//(a code moves the predictor by up to 15/8 of the step size)
+	int32_t index = 0;
+	while (index < 88 && 2 * int32_t(StepSizes[index]) < largest) ++index;
+	return index;
+}
+
+void encode_adpcm(float const *samples, size_t count, std::vector< uint8_t > *out) {
+	assert(out);
+	size_t blocks = (count + ADPCMBlockSamples - 1) / ADPCMBlockSamples;
+	out->assign(blocks * ADPCMBlockBytes, 0);
+
+	ADPCMSteps const &steps = adpcm_steps();
+	ADPCMState state;
+	state.index = initial_index(samples, count);
+	for (size_t b = 0; b < blocks; ++b) {
+		uint8_t *block = out->data() + b * ADPCMBlockBytes;
+		size_t first = b * ADPCMBlockSamples;
+
+		//each block restarts from (a quantized copy of) its first sample, keeping the step size from the last block:
+		state.predictor = quantize(samples[first]);
+		block[0] = uint8_t(state.predictor & 0xff);
+		block[1] = uint8_t((state.predictor >> 8) & 0xff);
+		block[2] = uint8_t(state.index);
+		block[3] = 0;
+
+		for (uint32_t i = 0; i < ADPCMBlockSamples; ++i) {
+			int32_t target = (first + i < count ? quantize(samples[first + i]) : 0);
+
+			//pick the code whose step best approaches the target:
+			int32_t step = StepSizes[state.index];
+			int32_t diff = target - state.predictor;
+			uint8_t code = 0;
+			if (diff < 0) {
+				code = 8;
+				diff = -diff;
+			}
+			if (diff >= step) { code |= 4; diff -= step; }
+			step >>= 1;
+			if (diff >= step) { code |= 2; diff -= step; }
+			step >>= 1;
+			if (diff >= step) { code |= 1; }
+
+			state.step(steps, code);
+			block[4 + i / 2] |= (i & 1) ? uint8_t(code << 4) : code;
+		}
+	}
+}
+
+//helper: start decoding 'block':
+static inline ADPCMState block_state(uint8_t const *block) {
+	ADPCMState state;
+	state.predictor = int16_t(uint16_t(block[0]) | uint16_t(block[1]) << 8);
+	state.index = block[2];
+	return state;
+}
+
+//helper: decode four whole blocks at once;
+// each block is a serial chain of table lookups, so interleaving independent blocks keeps the CPU busy:
+static void decode_four_blocks(ADPCMSteps const &steps, uint8_t const *blocks, float *out) {
+	ADPCMState state[4];
+	for (uint32_t b = 0; b < 4; ++b) {
+		state[b] = block_state(blocks + b * ADPCMBlockBytes);
+	}
+	for (uint32_t i = 0; i < ADPCMBlockSamples; ++i) {
+		for (uint32_t b = 0; b < 4; ++b) {
+			uint8_t const *codes = blocks + b * ADPCMBlockBytes + 4;
+			state[b].step(steps, (codes[i / 2] >> (4 * (i & 1))) & 0xf);
+			out[b * ADPCMBlockSamples + i] = float(state[b].predictor) * (1.0f / 32768.0f);
+		}
+	}
+}
+
+void decode_adpcm(uint8_t const *blocks, size_t begin, uint32_t count, float *out, ADPCMPosition *position) {
+	assert(blocks || count == 0);
+	ADPCMSteps const &steps = adpcm_steps();
+	while (count > 0) {
+		uint8_t const *block = blocks + (begin / ADPCMBlockSamples) * ADPCMBlockBytes;
+		uint32_t skip = uint32_t(begin % ADPCMBlockSamples);
+
+		if (skip == 0 && count >= 4 * ADPCMBlockSamples) {
+			decode_four_blocks(steps, block, out);
+			out += 4 * ADPCMBlockSamples;
+			begin += 4 * ADPCMBlockSamples;
+			count -= 4 * ADPCMBlockSamples;
+			continue;
+		}
+
+		uint32_t take = std::min(count, ADPCMBlockSamples - skip);
+		ADPCMState state = block_state(block);
+		uint8_t const *codes = block + 4;
+
+		if (skip != 0 && position && position->next == begin) {
+			//pick up where the last call left off:
+			state.predictor = position->predictor;
+			state.index = position->index;
+		} else {
+			//run through (but don't output) samples before 'begin':
+			for (uint32_t i = 0; i < skip; ++i) {
+				state.step(steps, (codes[i / 2] >> (4 * (i & 1))) & 0xf);
+			}
+		}
+		for (uint32_t i = skip; i < skip + take; ++i) {
+			state.step(steps, (codes[i / 2] >> (4 * (i & 1))) & 0xf);
+			*(out++) = float(state.predictor) * (1.0f / 32768.0f);
+		}
+
+		begin += take;
+		count -= take;
+
+		if (position) {
+			position->next = begin;
+			position->predictor = state.predictor;
+			position->index = state.index;
+		}
+	}
+}
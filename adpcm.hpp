@@ -0,0 +1,30 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+//IMA-ADPCM encoding of mono audio (used by Sound::Sample to store sounds in about 1/8 the memory of floats):
+// samples are coded as 4-bit steps, in independent blocks of ADPCMBlockSamples samples
+// so playback can start decoding at any block:
+//   [int16 predictor][uint8 step index][uint8 unused][ADPCMBlockSamples / 2 bytes of steps, low nibble first]
+
+constexpr uint32_t ADPCMBlockSamples = 256;
+constexpr uint32_t ADPCMBlockBytes = 4 + ADPCMBlockSamples / 2;
+
+//Encode 'count' samples (in [-1,1]; values outside are clamped) into 'out' (replacing its contents);
+// the last block is padded with silence:
+void encode_adpcm(float const *samples, size_t count, std::vector< uint8_t > *out);
+
+//Decoder state partway through a block, so a later decode_adpcm() call can pick up where an earlier one stopped:
+struct ADPCMPosition {
+	size_t next = 0; //sample the state below is ready to decode
+	int32_t predictor = 0;
+	int32_t index = 0;
+};
+
+//Decode samples [begin, begin + count) from encoded 'blocks' into 'out':
+// (decoding starts at the block containing 'begin', so it is cheapest when 'begin' is a multiple of ADPCMBlockSamples)
+//if 'position' is given, decoding resumes from it when position->next == begin, and it is updated to where decoding stopped
+// (so playing a sample in short runs doesn't re-decode the start of each block every run)
+void decode_adpcm(uint8_t const *blocks, size_t begin, uint32_t count, float *out, ADPCMPosition *position = nullptr);
@@ -0,0 +1,173 @@
+//bench-sound: times the audio mixer (Sound::render) with lots of synthetic voices.
+// usage: bench-sound [blocks per voice count (default 2000)] [block size (default 1024)] [mixing threads (default 0)] [sample encoding: float (default), int16, or adpcm]
+// For each voice count in the sweep, half the voices are 2D and half are 3D (moving around a moving listener).
+// Reports the mean cost per voice per sample and the 99th percentile time to mix one block.
+
+#include "Sound.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <stdexcept>
+#include <vector>
+
+int main(int argc, char **argv) {
+#ifdef _WIN32
+	//when compiled on windows, unhandled exceptions don't have their message printed, which can make debugging simple issues difficult.
+	try {
+#endif
+
+	uint32_t blocks = 2000;
+	uint32_t block_frames = 1024;
+	uint32_t mix_threads = 0;
+	Sound::Sample::Encoding encoding = Sound::Sample::Float;
+	if (argc >= 2) {
+		blocks = uint32_t(std::max(1, std::atoi(argv[1])));
+	}
+	bool bad_args = (argc > 5);
+	if (argc >= 3) {
+		block_frames = uint32_t(std::max(0, std::atoi(argv[2])));
+		//(same sizes Sound::init_headless accepts -- it would quietly use 1024 instead of anything else)
+		if (block_frames < 16 || block_frames > 4096 || (block_frames & (block_frames - 1)) != 0) {
+			std::cerr << "Block size must be a power of two between 16 and 4096." << std::endl;
+			bad_args = true;
+		}
+	}
+	if (argc >= 4) {
+		mix_threads = uint32_t(std::max(0, std::atoi(argv[3])));
+	}
+	if (argc >= 5) {
+		std::string arg = argv[4];
+		if (arg == "float") encoding = Sound::Sample::Float;
+		else if (arg == "int16") encoding = Sound::Sample::Int16;
+		else if (arg == "adpcm") encoding = Sound::Sample::ADPCM;
+		else bad_args = true;
+	}
+	if (bad_args) {
+		std::cerr << "Usage:\n\t./bench-sound [blocks] [block size] [mixing threads] [float|int16|adpcm]" << std::endl;
+		return 1;
+	}
+
+	//this matches the mixer's output rate:
+	constexpr uint32_t const Rate = 48000;
+	float const block_time = float(block_frames) / float(Rate);
+
+	Sound::init_headless(block_frames, mix_threads);
+
+	//------------ synthetic samples --------------
+	//n.b. always the same (fixed seed) so runs are comparable:
+	std::mt19937 mt(0x15466);
+
+	std::vector< Sound::Sample > samples;
+	samples.reserve(16);
+	for (uint32_t i = 0; i < 16; ++i) {
+		//between half a second and three seconds of a detuned tone plus noise:
+		std::vector< float > data(Rate / 2 + mt() % (Rate * 5 / 2));
+		float freq = 110.0f * float(i + 1);
+		for (uint32_t s = 0; s < data.size(); ++s) {
+			float noise = float(mt()) / float(mt.max()) * 2.0f - 1.0f;
+			data[s] = 0.5f * std::sin(2.0f * 3.1415926f * freq * float(s) / float(Rate)) + 0.1f * noise;
+		}
+		samples.emplace_back(data, encoding);
+	}
+	size_t sample_bytes = 0;
+	for (auto const &sample : samples) {
+		sample_bytes += sample.bytes();
+	}
+
+	//------------ sweep --------------
+	std::vector< float > buffer(2 * block_frames);
+	std::vector< double > block_ns(blocks);
+	double checksum = 0.0; //(printed so the compiler can't skip any mixing)
+
+	std::cout << "Mixing " << blocks << " blocks of " << block_frames << " samples per voice count";
+	if (mix_threads) std::cout << " (with " << mix_threads << " mixing threads)";
+	std::cout << "; samples use " << sample_bytes / 1024 << "kB." << std::endl;
+	std::cout << std::setw(8) << "voices"
+		<< std::setw(18) << "ns/voice/sample"
+		<< std::setw(16) << "mean block us"
+		<< std::setw(15) << "p99 block us"
+		<< std::setw(16) << "p99 % of block" << std::endl;
+
+	for (uint32_t count = 1; count <= Sound::MaxVoices; count *= 4) {
+		//start voices: (looping, so the voice count stays fixed for the whole run)
+		std::vector< Sound::PlayingSample > voices_2D, voices_3D;
+		std::vector< float > phases;
+		for (uint32_t v = 0; v < count; ++v) {
+			Sound::Sample const &sample = samples[v % samples.size()];
+			float volume = 1.0f / float(count);
+			if (v % 2 == 0) {
+				voices_2D.emplace_back(Sound::loop(sample, volume, float(mt()) / float(mt.max()) * 2.0f - 1.0f));
+			} else {
+				voices_3D.emplace_back(Sound::loop_3D(sample, volume, glm::vec3(0.0f), 10.0f));
+				phases.emplace_back(float(mt()) / float(mt.max()) * 2.0f * 3.1415926f);
+			}
+		}
+
+		double total_ns = 0.0;
+		for (uint32_t b = 0; b < blocks; ++b) {
+			//move things around, as a game would once per frame:
+			float t = float(b) * block_time;
+			Sound::listener.set_position_right(
+				glm::vec3(std::cos(0.3f * t), std::sin(0.3f * t), 0.0f),
+				glm::vec3(std::cos(0.5f * t), std::sin(0.5f * t), 0.0f),
+				block_time
+			);
+			for (uint32_t v = 0; v < voices_3D.size(); ++v) {
+				float a = phases[v] + t;
+				voices_3D[v].set_position(glm::vec3(5.0f * std::cos(a), 5.0f * std::sin(a), std::sin(2.0f * a)), block_time);
+			}
+			if (b % 8 == 0) {
+				for (auto &voice : voices_2D) {
+					voice.set_pan(std::sin(t + float(&voice - &voices_2D[0])), block_time);
+				}
+			}
+
+			auto before = std::chrono::high_resolution_clock::now();
+			Sound::render(buffer.data(), block_frames);
+			auto after = std::chrono::high_resolution_clock::now();
+
+			block_ns[b] = std::chrono::duration< double, std::nano >(after - before).count();
+			total_ns += block_ns[b];
+			checksum += buffer[b % buffer.size()];
+		}
+
+		std::sort(block_ns.begin(), block_ns.end());
+		double p99 = block_ns[std::min< size_t >(block_ns.size() - 1, size_t(0.99 * block_ns.size()))];
+
+		std::cout << std::setw(8) << count
+			<< std::fixed
+			<< std::setw(18) << std::setprecision(3) << total_ns / (double(blocks) * double(block_frames) * double(count))
+			<< std::setw(16) << std::setprecision(1) << total_ns / double(blocks) * 1e-3
+			<< std::setw(15) << std::setprecision(1) << p99 * 1e-3
+			<< std::setw(16) << std::setprecision(2) << 100.0 * p99 * 1e-9 / double(block_time)
+			<< std::endl;
+
+		//let the voices fade out and finish before the next run:
+		Sound::stop_all_samples();
+		for (uint32_t b = 0; b < 8; ++b) {
+			Sound::render(buffer.data(), block_frames);
+		}
+	}
+
+	std::cout << "(checksum: " << checksum << ")" << std::endl;
+
+	Sound::shutdown();
+
+	return 0;
+
+#ifdef _WIN32
+	} catch (std::exception const &e) {
+		std::cerr << "Unhandled exception:\n" << e.what() << std::endl;
+		return 1;
+	} catch (...) {
+		std::cerr << "Unhandled exception (unknown type)." << std::endl;
+		throw;
+	}
+#endif
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <new>
+#include <utility>
+#include <iterator>
+#include <cstddef>
+#include <cstdint>
+#include <cassert>
+
+//Container that never moves its elements (so pointers to them stay valid, as with std::list),
+// but stores them contiguously in fixed-size chunks (so iterating is a linear walk through memory, and
+// adding an element only allocates once per 'ChunkSize' elements):
+// elements are added with emplace_back() and removed with pop_back() or clear() -- there is no erase from the middle.
+template< typename T, uint32_t ChunkSize = 256 >
+struct ChunkedPool {
+	ChunkedPool() = default;
+	~ChunkedPool() { clear(); }
+
+	//copying copies elements (so T must be copyable to use these):
+	ChunkedPool(ChunkedPool const &other) { *this = other; }
+	ChunkedPool &operator=(ChunkedPool const &other) {
+		if (this == &other) return *this;
+		clear();
+		for (T const &item : other) {
+			emplace_back(item);
+		}
+		return *this;
+	}
+	//moving hands over the chunks (so pointers to elements stay valid):
+	ChunkedPool(ChunkedPool &&other) { *this = std::move(other); }
+	ChunkedPool &operator=(ChunkedPool &&other) {
+		if (this == &other) return *this;
+		clear();
+		chunks = std::move(other.chunks);
+		count = other.count;
+		other.chunks.clear();
+		other.count = 0;
+		return *this;
+	}
+
+	template< typename... Args >
+	T &emplace_back(Args&&... args) {
+		if (count == chunks.size() * ChunkSize) {
+			chunks.emplace_back(std::make_unique< Chunk >());
+		}
+		T *item = new (slot(count)) T(std::forward< Args >(args)...);
+		++count;
+		return *item;
+	}
+	void pop_back() {
+		assert(count > 0);
+		--count;
+		slot(count)->~T();
+	}
+	//destroys all elements (but keeps chunks around for reuse):
+	void clear() {
+		while (count > 0) pop_back();
+	}
+
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+
+	T &operator[](size_t i) { assert(i < count); return *slot(i); }
+	T const &operator[](size_t i) const { assert(i < count); return *slot(i); }
+	T &front() { return (*this)[0]; }
+	T const &front() const { return (*this)[0]; }
+	T &back() { return (*this)[count - 1]; }
+	T const &back() const { return (*this)[count - 1]; }
+
+	//iterators walk each chunk with a pointer, only looking up the next chunk at chunk boundaries:
+	template< typename Pool, typename Item >
+	struct Iterator {
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = T;
+		using difference_type = std::ptrdiff_t;
+		using pointer = Item *;
+		using reference = Item &;
+
+		Pool *pool = nullptr;
+		size_t index = 0;
+		Item *item = nullptr;
+
+		Iterator() = default;
+		Iterator(Pool *pool_, size_t index_) : pool(pool_), index(index_) {
+			if (index < pool->count) item = pool->slot(index);
+		}
+		Item &operator*() const { return *item; }
+		Item *operator->() const { return item; }
+		Iterator &operator++() {
+			++index;
+			++item;
+			if (index % ChunkSize == 0 && index < pool->count) item = pool->slot(index);
+			return *this;
+		}
+		Iterator operator++(int) {
+			Iterator ret = *this;
+			++*this;
+			return ret;
+		}
+		bool operator==(Iterator const &other) const { return index == other.index; }
+		bool operator!=(Iterator const &other) const { return index != other.index; }
+	};
+	using iterator = Iterator< ChunkedPool, T >;
+	using const_iterator = Iterator< ChunkedPool const, T const >;
+
+	iterator begin() { return iterator(this, 0); }
+	iterator end() { return iterator(this, count); }
+	const_iterator begin() const { return const_iterator(this, 0); }
+	const_iterator end() const { return const_iterator(this, count); }
+
+	//storage:
+	struct Chunk {
+		alignas(T) unsigned char bytes[sizeof(T) * ChunkSize];
+	};
+	std::vector< std::unique_ptr< Chunk > > chunks;
+	size_t count = 0;
+
+	T *slot(size_t i) const {
+		return reinterpret_cast< T * >(chunks[i / ChunkSize]->bytes) + (i % ChunkSize);
+	}
+};
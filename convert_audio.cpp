@@ -0,0 +1,243 @@
+#include "convert_audio.hpp"
+#include "mix_kernel.hpp"
+
+#include <SDL.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+
+constexpr uint32_t AUDIO_RATE = 48000;
+
+//input is added to the filter history this many samples at a time, between runs of the resampler:
+// (filtering one output sample per input sample would read each sample right after writing it, which stalls the CPU)
+constexpr uint32_t HistoryBatch = 1024;
+
+//max rows in the filter table; rate ratios that would need more (e.g., 48000 / 44099) interpolate between rows:
+constexpr uint32_t MaxPhases = 1024;
+
+//helpers: read one sample in various formats as a float in [-1,1):
+static inline uint32_t read_u16(uint8_t const *p, bool big) {
+	return big ? (uint32_t(p[0]) << 8 | p[1]) : (uint32_t(p[1]) << 8 | p[0]);
+}
+static inline uint32_t read_u32(uint8_t const *p, bool big) {
+	return big
+		? (uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 8 | p[3])
+		: (uint32_t(p[3]) << 24 | uint32_t(p[2]) << 16 | uint32_t(p[1]) << 8 | p[0]);
+}
+
+//helper: convert 'frames' whole frames to mono float, passing each sample to 'emit':
+template< typename ReadSample, typename Emit >
+static void for_each_mono(uint8_t const *bytes, size_t frames, uint32_t channels, uint32_t sample_bytes, ReadSample const &read, Emit const &emit) {
+	float scale = 1.0f / float(channels);
+	for (size_t f = 0; f < frames; ++f) {
+		float sum = 0.0f;
+		for (uint32_t c = 0; c < channels; ++c) {
+			sum += read(bytes);
+			bytes += sample_bytes;
+		}
+		emit(sum * scale);
+	}
+}
+
+//helper: convert 'frames' whole frames in 'format' to mono float, passing each sample to 'emit':
+template< typename Emit >
+static void read_mono(uint16_t format, uint8_t const *bytes, size_t frames, uint32_t channels, Emit const &emit) {
+	bool big = SDL_AUDIO_ISBIGENDIAN(format);
+	switch (format) {
+		case AUDIO_U8:
+			for_each_mono(bytes, frames, channels, 1, [](uint8_t const *p){ return (float(p[0]) - 128.0f) / 128.0f; }, emit);
+			break;
+		case AUDIO_S8:
+			for_each_mono(bytes, frames, channels, 1, [](uint8_t const *p){ return float(int8_t(p[0])) / 128.0f; }, emit);
+			break;
+		case AUDIO_U16LSB: case AUDIO_U16MSB:
+			for_each_mono(bytes, frames, channels, 2, [big](uint8_t const *p){ return (float(read_u16(p, big)) - 32768.0f) / 32768.0f; }, emit);
+			break;
+		case AUDIO_S16LSB: case AUDIO_S16MSB:
+			for_each_mono(bytes, frames, channels, 2, [big](uint8_t const *p){ return float(int16_t(read_u16(p, big))) / 32768.0f; }, emit);
+			break;
+		case AUDIO_S32LSB: case AUDIO_S32MSB:
+			for_each_mono(bytes, frames, channels, 4, [big](uint8_t const *p){ return float(int32_t(read_u32(p, big))) / 2147483648.0f; }, emit);
+			break;
+		case AUDIO_F32LSB: case AUDIO_F32MSB:
+			for_each_mono(bytes, frames, channels, 4, [big](uint8_t const *p){
+				uint32_t bits = read_u32(p, big);
+				float value;
+				std::memcpy(&value, &bits, 4);
+				return value;
+			}, emit);
+			break;
+		default:
+			assert(0 && "format was checked in constructor");
+	}
+}
+
+AudioConverter::AudioConverter(uint16_t format_, uint32_t channels_, uint32_t rate_) : format(format_), channels(channels_), rate(rate_) {
+	switch (format) {
+		case AUDIO_U8: case AUDIO_S8:
+		case AUDIO_U16LSB: case AUDIO_U16MSB: case AUDIO_S16LSB: case AUDIO_S16MSB:
+		case AUDIO_S32LSB: case AUDIO_S32MSB:
+		case AUDIO_F32LSB: case AUDIO_F32MSB:
+			break;
+		default:
+			throw std::runtime_error("Unsupported audio format " + std::to_string(format) + ".");
+	}
+	if (channels == 0 || rate == 0) {
+		throw std::runtime_error("Audio has " + std::to_string(channels) + " channels at " + std::to_string(rate) + "Hz; expected at least one channel and a non-zero rate.");
+	}
+	frame_bytes = (SDL_AUDIO_BITSIZE(format) / 8) * channels;
+
+	if (rate == AUDIO_RATE) return; //no resampling needed
+
+	uint32_t g = std::gcd(rate, AUDIO_RATE);
+	up = AUDIO_RATE / g;
+	down = rate / g;
+
+	//low-pass at the lower of the two Nyquist frequencies (with a little room for the transition band),
+	// measured in cycles per input sample * 2:
+	float cutoff = 0.95f * std::min(1.0f, float(AUDIO_RATE) / float(rate));
+	//widen the filter when cutting off lower so the transition band stays about as sharp:
+	half_taps = std::min(128U, uint32_t(std::ceil(16.0f / cutoff)));
+	phases = std::min(up, MaxPhases);
+
+	//windowed sinc, sampled at each fractional position:
+	uint32_t taps = 2 * half_taps;
+	filters.resize(size_t(phases + 1) * taps);
+	for (uint32_t row = 0; row <= phases; ++row) {
+		float frac = float(row) / float(phases);
+		float *filter = &filters[size_t(row) * taps];
+		float sum = 0.0f;
+		for (uint32_t k = 0; k < taps; ++k) {
+			//tap k reads input sample (position - half_taps + 1 + k), which is this far from the output position:
+			float x = float(k) - float(half_taps) + 1.0f - frac;
+			float t = x / float(half_taps); //window position in [-1,1]
+			float window = 0.0f;
+			if (std::abs(t) < 1.0f) {
+				//Blackman window:
+				window = 0.42f + 0.5f * std::cos(3.1415926f * t) + 0.08f * std::cos(2.0f * 3.1415926f * t);
+			}
+			float y = 3.1415926f * cutoff * x;
+			float sinc = (y == 0.0f ? 1.0f : std::sin(y) / y);
+			filter[k] = cutoff * sinc * window;
+			sum += filter[k];
+		}
+		//normalize so each phase passes DC at exactly unit gain:
+		for (uint32_t k = 0; k < taps; ++k) {
+			filter[k] /= sum;
+		}
+	}
+
+	//history holds a filter's worth of input plus a batch of new input (power of two, so positions wrap with a mask):
+	history_size = 1;
+	while (history_size < taps + HistoryBatch) history_size *= 2;
+	history.assign(2 * history_size, 0.0f);
+
+	//start with half_taps of silence so the first output sample is centered on the first input sample:
+	input_end = half_taps;
+	update_next_output();
+}
+
+uint64_t AudioConverter::output_size(uint64_t frames) const {
+	return (frames * up + down - 1) / down;
+}
+
+void AudioConverter::convert(uint8_t const *bytes, size_t count, std::vector< float > *out) {
+	assert(out);
+
+	//finish a frame started in an earlier chunk:
+	if (!partial_frame.empty()) {
+		size_t take = std::min(count, frame_bytes - partial_frame.size());
+		partial_frame.insert(partial_frame.end(), bytes, bytes + take);
+		bytes += take;
+		count -= take;
+		if (partial_frame.size() < frame_bytes) return;
+		std::vector< uint8_t > frame;
+		std::swap(frame, partial_frame);
+		convert(frame.data(), frame.size(), out);
+	}
+
+	size_t frames = count / frame_bytes;
+	partial_frame.assign(bytes + frames * frame_bytes, bytes + count);
+	frames_in += frames;
+
+	if (up == down) {
+		//without resampling, mono samples go straight to the output:
+		size_t base = out->size();
+		out->resize(base + frames);
+		float *dst = out->data() + base;
+		read_mono(format, bytes, frames, channels, [&dst](float value){ *(dst++) = value; });
+		samples_out += frames;
+	} else {
+		//otherwise, they go through the filter history, a batch at a time:
+		for (size_t done = 0; done < frames; /* later */) {
+			size_t batch = std::min< size_t >(frames - done, HistoryBatch);
+			read_mono(format, bytes + done * frame_bytes, batch, channels, [this](float value){ push(value); });
+			resample(out);
+			done += batch;
+		}
+	}
+}
+
+void AudioConverter::finish(std::vector< float > *out) {
+	assert(out);
+	if (up == down) return;
+
+	//pad with silence so the remaining output samples can be computed:
+	uint64_t total = output_size(frames_in);
+	for (uint32_t i = 0; i < 2 * half_taps + 1; ++i) {
+		push(0.0f);
+	}
+	resample(out);
+	assert(samples_out >= total);
+	//(padding may have allowed a few output samples past the end of the input; drop them)
+	out->resize(out->size() - size_t(samples_out - total));
+	samples_out = total;
+}
+
+void AudioConverter::update_next_output() {
+	//output sample 'samples_out' lands at this position in the (padded) input, and its filter reads up to half_taps past it:
+	uint64_t num = samples_out * down;
+	next_output_phase = uint32_t(num % up);
+	next_output_end = num / up + 2 * half_taps + 1;
+}
+
+void AudioConverter::push(float value) {
+	//store the sample twice, so the last history_size samples can always be read contiguously:
+	uint32_t at = uint32_t(input_end & (history_size - 1));
+	history[at] = value;
+	history[at + history_size] = value;
+	++input_end;
+}
+
+void AudioConverter::resample(std::vector< float > *out) {
+	//produce any output samples whose filters are now covered:
+	uint32_t taps = 2 * half_taps;
+	while (input_end >= next_output_end) {
+		//filter reads [position - half_taps + 1, position + half_taps] == [next_output_end - taps, next_output_end):
+		uint64_t first = next_output_end - taps;
+		assert(first + history_size >= input_end); //(still in the history)
+		float const *x = history.data() + (first & (history_size - 1));
+		uint32_t rem = next_output_phase;
+
+		float result;
+		if (phases == up) {
+			result = dot_product(x, &filters[size_t(rem) * taps], taps);
+		} else {
+			//interpolate between neighboring rows of the table:
+			float at = float(rem) * float(phases) / float(up);
+			uint32_t row = std::min(uint32_t(at), phases - 1);
+			float t = at - float(row);
+			float a = dot_product(x, &filters[size_t(row) * taps], taps);
+			float b = dot_product(x, &filters[size_t(row + 1) * taps], taps);
+			result = a + t * (b - a);
+		}
+		out->emplace_back(result);
+		++samples_out;
+		update_next_output();
+	}
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+//Convert interleaved PCM audio in any SDL audio format (AUDIO_U8, AUDIO_S16LSB, AUDIO_F32MSB, ...),
+// channel count, and sampling rate into 48kHz floating-point mono (used by load_wav):
+// - channels are averaged, and the rate is changed with a windowed-sinc polyphase resampler
+// - input can be supplied in chunks of any size (even splitting frames), so this also works for streaming
+// - output is appended directly to the destination vector; only a filter's worth of input history is kept between samples
+struct AudioConverter {
+	//throws if 'format' isn't supported:
+	AudioConverter(uint16_t format, uint32_t channels, uint32_t rate);
+
+	//convert 'count' bytes of input, appending any finished output samples to 'out':
+	void convert(uint8_t const *bytes, size_t count, std::vector< float > *out);
+
+	//after the last chunk, append the output samples that were waiting on input that will never arrive:
+	void finish(std::vector< float > *out);
+
+	//number of output samples 'frames' input frames will turn into:
+	uint64_t output_size(uint64_t frames) const;
+
+	//input format:
+	uint16_t format;
+	uint32_t channels;
+	uint32_t rate;
+	uint32_t frame_bytes;
+	std::vector< uint8_t > partial_frame; //start of a frame split between chunks
+
+	//resampler: 48kHz = rate * up / down, so output sample n is at input position n * down / up
+	uint32_t up = 1;
+	uint32_t down = 1;
+	uint32_t half_taps = 0; //filter uses this many input samples on either side of each output's position
+	uint32_t phases = 0; //rows in the filter table (fractional input positions)
+	std::vector< float > filters; //(phases + 1) rows of (2 * half_taps) coefficients
+
+	//filter history: the last history_size mono input samples, each stored twice (at i and i + history_size) so that
+	// the samples a filter reads are always contiguous; n.b. positions are in the input stream with 'half_taps' zeros added at the start:
+	std::vector< float > history;
+	uint32_t history_size = 0; //power of two, with room for 2 * half_taps samples plus a batch of new input
+	uint64_t input_end = 0; //position of the next input sample
+	uint64_t frames_in = 0; //input frames seen so far
+	uint64_t samples_out = 0; //output samples produced so far
+	uint64_t next_output_end = 0; //the next output sample can be computed once input_end reaches this
+	uint32_t next_output_phase = 0; //fractional position of the next output sample (in units of 1/up)
+
+	//helper: add a mono input sample to the history:
+	void push(float value);
+	//helper: append output samples whose filters are covered by the history to 'out':
+	void resample(std::vector< float > *out);
+	//helper: compute next_output_end/phase from samples_out:
+	void update_next_output();
+};
@@ -0,0 +1,81 @@
+#include "convolution_reverb.hpp"
+#include "mix_kernel.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+ConvolutionReverb::ConvolutionReverb(std::vector< float > const &impulse_left, std::vector< float > const &impulse_right, uint32_t block_)
+	: block(block_), fft(2 * block_) {
+	size_t length = std::max(impulse_left.size(), impulse_right.size());
+	if (length == 0) {
+		throw std::runtime_error("Reverb impulse response is empty.");
+	}
+	partitions = uint32_t((length + block - 1) / block);
+
+	uint32_t size = 2 * block;
+	filter_re.assign(size_t(partitions) * size, 0.0f);
+	filter_im.assign(size_t(partitions) * size, 0.0f);
+	history_re.assign(size_t(partitions) * size, 0.0f);
+	history_im.assign(size_t(partitions) * size, 0.0f);
+	input_window.assign(size, 0.0f);
+	work_re.assign(size, 0.0f);
+	work_im.assign(size, 0.0f);
+
+	//filter spectra: left partition in the real part and right in the imaginary part of one FFT,
+	// which gives exactly (left spectrum + i * right spectrum), since the FFT is linear:
+	float scale = 1.0f / float(size); //(inverse FFT doesn't scale)
+	for (uint32_t p = 0; p < partitions; ++p) {
+		float *re = &filter_re[size_t(p) * size];
+		float *im = &filter_im[size_t(p) * size];
+		for (uint32_t i = 0; i < block; ++i) {
+			size_t at = size_t(p) * block + i;
+			re[i] = (at < impulse_left.size() ? impulse_left[at] * scale : 0.0f);
+			im[i] = (at < impulse_right.size() ? impulse_right[at] * scale : 0.0f);
+		}
+		fft.forward(re, im);
+	}
+
+	silent_blocks = partitions + 2; //(nothing to do until there is some input)
+}
+
+void ConvolutionReverb::process(float const *input, float *out) {
+	uint32_t size = 2 * block;
+
+	//slide input window along:
+	std::copy(input_window.begin() + block, input_window.end(), input_window.begin());
+	std::copy(input, input + block, input_window.begin() + block);
+
+	//skip work once everything in the history is the spectrum of silence:
+	bool silent = std::all_of(input, input + block, [](float x){ return x == 0.0f; });
+	silent_blocks = (silent ? silent_blocks + 1 : 0);
+	if (silent_blocks > partitions + 1) return;
+
+	//spectrum of the input window goes into the history:
+	history_head = (history_head + 1) % partitions;
+	float *x_re = &history_re[size_t(history_head) * size];
+	float *x_im = &history_im[size_t(history_head) * size];
+	std::copy(input_window.begin(), input_window.end(), x_re);
+	std::fill(x_im, x_im + size, 0.0f);
+	fft.forward(x_re, x_im);
+
+	//sum products of input spectra with partition spectra (the newest input goes with the first partition):
+	std::fill(work_re.begin(), work_re.end(), 0.0f);
+	std::fill(work_im.begin(), work_im.end(), 0.0f);
+	for (uint32_t p = 0; p < partitions; ++p) {
+		uint32_t h = (history_head + partitions - p) % partitions;
+		complex_multiply_add(
+			work_re.data(), work_im.data(),
+			&history_re[size_t(h) * size], &history_im[size_t(h) * size],
+			&filter_re[size_t(p) * size], &filter_im[size_t(p) * size],
+			size
+		);
+	}
+
+	//back to samples; the second half is the (alias-free) output for this block:
+	fft.inverse(work_re.data(), work_im.data());
+	for (uint32_t i = 0; i < block; ++i) {
+		out[2*i+0] += work_re[block + i];
+		out[2*i+1] += work_im[block + i];
+	}
+}
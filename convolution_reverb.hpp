@@ -0,0 +1,35 @@
+#pragma once
+
+#include "fft.hpp"
+
+#include <vector>
+#include <cstdint>
+
+//Stereo convolution reverb (used by Sound for its reverb send bus):
+// convolves mono input with a left and a right impulse response by uniformly partitioned overlap-save --
+// the impulse responses are split into block-sized partitions, and each block of output is the sum of
+// (spectrum of a recent input block) * (spectrum of a partition), so a block costs two FFTs and
+// one complex multiply-add per partition however many sounds are mixed into the input.
+struct ConvolutionReverb {
+	//'block' (a power of two >= 4) is the number of samples handled by each call to process():
+	ConvolutionReverb(std::vector< float > const &impulse_left, std::vector< float > const &impulse_right, uint32_t block);
+
+	//convolve 'block' samples of 'input', adding the result to interleaved stereo 'out':
+	// (doesn't allocate, so it is fine to call from the audio callback)
+	void process(float const *input, float *out);
+
+	uint32_t block;
+	uint32_t partitions;
+	FFT fft; //(size 2 * block)
+
+	//each partition's spectrum of (left + i * right), scaled by 1 / (2 * block), one after another:
+	// (since both impulse responses are real, one inverse FFT of the product recovers left in the real part and right in the imaginary part)
+	std::vector< float > filter_re, filter_im;
+	//spectra of the last 'partitions' blocks of input, as a ring buffer:
+	std::vector< float > history_re, history_im;
+	uint32_t history_head = 0; //most recent spectrum
+	std::vector< float > input_window; //last two blocks of input
+	std::vector< float > work_re, work_im; //scratch
+	//once the input has been silent long enough for the reverb tail to end, process() skips the work:
+	uint32_t silent_blocks = 0;
+};
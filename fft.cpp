@@ -0,0 +1,70 @@
+#include "fft.hpp"
+#include "mix_kernel.hpp"
+
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+FFT::FFT(uint32_t size_) : size(size_) {
+	if (size < 4 || (size & (size - 1)) != 0) {
+		throw std::runtime_error("FFT size " + std::to_string(size) + " isn't a power of two >= 4.");
+	}
+
+	uint32_t bits = 0;
+	while ((1U << bits) < size) ++bits;
+	for (uint32_t i = 0; i < size; ++i) {
+		uint32_t j = 0;
+		for (uint32_t b = 0; b < bits; ++b) {
+			if (i & (1U << b)) j |= 1U << (bits - 1 - b);
+		}
+		if (i < j) {
+			bit_reverse.emplace_back(i);
+			bit_reverse.emplace_back(j);
+		}
+	}
+
+	//twiddles for stages after the radix-4 pass (half-sizes 4, 8, ..., size/2):
+	for (uint32_t half = 4; half < size; half *= 2) {
+		for (uint32_t k = 0; k < half; ++k) {
+			double angle = -3.14159265358979323846 * double(k) / double(half);
+			twiddle_re.emplace_back(float(std::cos(angle)));
+			twiddle_im.emplace_back(float(std::sin(angle)));
+		}
+	}
+}
+
+void FFT::forward(float *re, float *im) const {
+	for (uint32_t i = 0; i < bit_reverse.size(); i += 2) {
+		std::swap(re[bit_reverse[i]], re[bit_reverse[i+1]]);
+		std::swap(im[bit_reverse[i]], im[bit_reverse[i+1]]);
+	}
+
+	//first two stages as one radix-4 pass:
+	// (inputs are in bit-reversed order, so each group of four is x0, x2, x1, x3 of a 4-point DFT)
+	for (uint32_t g = 0; g < size; g += 4) {
+		float ar = re[g+0] + re[g+1], ai = im[g+0] + im[g+1]; //x0 + x2
+		float br = re[g+0] - re[g+1], bi = im[g+0] - im[g+1]; //x0 - x2
+		float cr = re[g+2] + re[g+3], ci = im[g+2] + im[g+3]; //x1 + x3
+		float dr = re[g+2] - re[g+3], di = im[g+2] - im[g+3]; //x1 - x3
+		re[g+0] = ar + cr; im[g+0] = ai + ci;
+		re[g+2] = ar - cr; im[g+2] = ai - ci;
+		//(-i * d):
+		re[g+1] = br + di; im[g+1] = bi - dr;
+		re[g+3] = br - di; im[g+3] = bi + dr;
+	}
+
+	//remaining stages:
+	uint32_t twiddle = 0;
+	for (uint32_t half = 4; half < size; half *= 2) {
+		for (uint32_t g = 0; g < size; g += 2 * half) {
+			fft_butterflies(re + g, im + g, re + g + half, im + g + half, &twiddle_re[twiddle], &twiddle_im[twiddle], half);
+		}
+		twiddle += half;
+	}
+}
+
+void FFT::inverse(float *re, float *im) const {
+	//conj(FFT(conj(x))) == inverse; swapping real and imaginary parts before and after does the same thing:
+	forward(im, re);
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+//In-place complex FFT of a fixed power-of-two size (used by the convolution reverb):
+// data is "split complex" -- separate arrays of real and imaginary parts -- so butterflies vectorize nicely.
+// The first two stages are done together as a radix-4 pass; later stages are radix-2 butterflies from mix_kernel.hpp.
+struct FFT {
+	//throws if 'size' isn't a power of two >= 4:
+	FFT(uint32_t size);
+
+	//forward transform: X[k] = sum_n x[n] e^{-2 pi i k n / size}
+	void forward(float *re, float *im) const;
+	//inverse transform, *without* the 1/size scale: x[n] = sum_k X[k] e^{2 pi i k n / size}
+	void inverse(float *re, float *im) const;
+
+	uint32_t size;
+	std::vector< uint32_t > bit_reverse; //pairs (i, j) with i < j to swap
+	//twiddle factors for each radix-2 stage, one after another (stage with half-size h uses h entries):
+	std::vector< float > twiddle_re, twiddle_im;
+};
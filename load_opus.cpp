@@ -7,14 +7,86 @@
 #include <cmath>
 #include <stdexcept>
 #include <iostream>
+#include <algorithm>
+#include <thread>
+#include <exception>
+
+//Long files are decoded in parallel: the file is split into chunks, each decoded by its own thread with its own
+// OggOpusFile handle. A chunk's thread seeks a little before the chunk (op_pcm_seek already starts decoding 80ms early,
+// as the Opus spec recommends; PreRoll adds more) and throws away samples before the chunk starts, so the decoder
+// has settled by the time samples are kept.
+//Opus decoders carry state from packet to packet, so that only makes a chunk match serial decoding once the seeked
+// decoder's state has converged. To check, each thread keeps decoding Overlap samples past the end of its chunk --
+// continuing serially from its own chunk -- and those are compared with the start of the next chunk. If they differ,
+// the next chunk is decoded again by carrying on with the previous chunk's handle, so the result always matches
+// serial decoding. (chunk 0 starts at the start of the file, so it is serial by construction)
+static constexpr uint64_t const PreRoll = 48000 / 2; //extra samples decoded (and discarded) before each chunk
+static constexpr uint64_t const Overlap = 48000 / 10; //samples decoded past each chunk to check the next chunk's start
+static constexpr uint64_t const MinChunk = 48000 * 10; //don't bother with chunks shorter than this
+static constexpr uint32_t const MaxChunks = 8;
+
+//helper: decode 'count' samples from the current position of 'op', downmixing them to mono in 'out' (or discarding them if 'out' is nullptr);
+// returns the number of samples decoded (fewer than 'count' only at the end of the file); throws on error.
+//n.b. never asks opusfile for more than 'count' samples: it keeps the rest of a partly-read packet buffered for the next read,
+// so the file position ends up exactly 'count' samples further along (decode_chunk relies on this after its pre-roll):
+static uint64_t read_mono(OggOpusFile *op, std::string const &filename, uint64_t count, float *out) {
+	std::vector< float > pcm(2*5760, 0.0f); //room for the longest opus packet (120ms)
+	uint64_t done = 0;
+	while (done < count) {
+		uint32_t want = uint32_t(std::min< uint64_t >(pcm.size() / 2, count - done));
+		int ret = op_read_float_stereo(op, pcm.data(), int(2 * want));
+		if (ret < 0) {
+			throw std::runtime_error("opusfile read error " + std::to_string(ret) + " reading \"" + filename + "\".");
+		}
+		if (ret == 0) break;
+		assert(uint32_t(ret) <= want);
+		if (out) {
+			for (uint32_t i = 0; i < uint32_t(ret); ++i) {
+				out[done + i] = (pcm[2*i] + pcm[2*i+1]) * 0.5f; //downmix to mono by averaging
+			}
+		}
+		done += uint32_t(ret);
+	}
+	return done;
+}
+
+//one chunk of a file being decoded in parallel:
+struct OpusChunk {
+	std::unique_ptr< OggOpusFile, decltype(&op_free) > op{ nullptr, op_free }; //(left just past 'overlap')
+	std::vector< float > overlap; //samples just past the end of the chunk
+	std::exception_ptr error;
+};
+
+//helper: decode samples [begin, end) of a file into 'out' and the Overlap samples after them into chunk.overlap,
+// using chunk.op (opening and seeking it first, if needed):
+static void decode_chunk(std::string const &filename, uint64_t begin, uint64_t end, float *out, OpusChunk &chunk) {
+	if (!chunk.op) {
+		int err = 0;
+		chunk.op.reset(op_open_file(filename.c_str(), &err));
+		if (err != 0 || !chunk.op) {
+			throw std::runtime_error("opusfile error " + std::to_string(err) + " opening \"" + filename + "\".");
+		}
+		uint64_t seek_to = (begin > PreRoll ? begin - PreRoll : 0);
+		int ret = op_pcm_seek(chunk.op.get(), ogg_int64_t(seek_to));
+		if (ret != 0) {
+			throw std::runtime_error("opusfile seek error " + std::to_string(ret) + " in \"" + filename + "\".");
+		}
+		if (read_mono(chunk.op.get(), filename, begin - seek_to, nullptr) != begin - seek_to) {
+			throw std::runtime_error("opusfile ended early while decoding \"" + filename + "\".");
+		}
+	}
+	if (read_mono(chunk.op.get(), filename, end - begin, out) != end - begin) {
+		throw std::runtime_error("opusfile ended early while decoding \"" + filename + "\".");
+	}
+	chunk.overlap.resize(Overlap);
+	chunk.overlap.resize(size_t(read_mono(chunk.op.get(), filename, Overlap, chunk.overlap.data())));
+}
 
 void load_opus(std::string const &filename, std::vector< float > *data_) {
 	assert(data_);
 	auto &data = *data_;
 	data.clear();
 
-	std::cout << "loading '" << filename << "'..."; std::cout.flush();
-
 	//will hold opusfile * int a std::unique_ptr so that it will automatically be deleted:
 	int err = 0;
 	std::unique_ptr< OggOpusFile, decltype(&op_free) > op(
@@ -27,28 +99,112 @@ void load_opus(std::string const &filename, std::vector< float > *data_) {
 
 	//get length in samples:
 	ogg_int64_t length = op_pcm_total(op.get(), -1);
-	if (length >= 0) {
-		data.reserve(length);
-	} else {
-		std::cerr << "WARNING: cannot estimate length of '" << filename << "', loading may be slow." << std::endl;
-		length = 0;
-		data.reserve(2*48000);
-	}
-
-	std::vector< float > pcm(2*48000*2, 0.0f); //seems like reads are generally 960 samples so this is definitely overkill
-	for (;;) {
-		int ret = op_read_float_stereo(op.get(), pcm.data(), int(pcm.size()));
-		if (ret >= 0) {
-			//positive return values are the number of samples read per channel; copy into data:
-			data.reserve(data.size() + ret);
-			for (uint32_t i = 0; i < uint32_t(ret); ++i) {
-				data.emplace_back((pcm[2*i] + pcm[2*i+1]) * 0.5f); //downmix to mono by averaging
-			}
-			if (ret == 0) break;
-		} else {
-			throw std::runtime_error("opusfile read error " + std::to_string(ret) + " reading \"" + filename + "\".");
+	if (length < 0) {
+		//can't seek, so decode front-to-back:
+		std::cerr << ("WARNING: cannot estimate length of '" + filename + "', loading may be slow.\n");
+		std::vector< float > block(48000);
+		for (;;) {
+			uint64_t count = read_mono(op.get(), filename, block.size(), block.data());
+			data.insert(data.end(), block.begin(), block.begin() + count);
+			if (count < block.size()) break;
 		}
+		std::cout << ("loaded '" + filename + "'.\n");
+		return;
+	}
+
+	//split into chunks (the first of which is decoded on this thread with the handle that is already open):
+	uint32_t chunks = std::max(1U, std::min({
+		std::thread::hardware_concurrency(),
+		MaxChunks,
+		uint32_t(uint64_t(length) / MinChunk)
+	}));
+	data.resize(size_t(length));
+	auto chunk_begin = [&](uint32_t c) { return uint64_t(length) * c / chunks; };
+
+	std::vector< OpusChunk > parts(chunks);
+	parts[0].op = std::move(op);
+	if (chunks == 1) {
+		//(op_pcm_total should be exact, but be forgiving when there's only one chunk)
+		data.resize(size_t(read_mono(parts[0].op.get(), filename, data.size(), data.data())));
+		std::cout << ("loaded '" + filename + "'.\n");
+		return;
 	}
 
-	std::cout << " done." << std::endl;
+	std::vector< std::thread > threads;
+	for (uint32_t c = 1; c < chunks; ++c) {
+		threads.emplace_back([&, c](){
+			try {
+				decode_chunk(filename, chunk_begin(c), chunk_begin(c + 1), data.data() + chunk_begin(c), parts[c]);
+			} catch (...) {
+				parts[c].error = std::current_exception();
+			}
+		});
+	}
+	try {
+		decode_chunk(filename, 0, chunk_begin(1), data.data(), parts[0]);
+	} catch (...) {
+		parts[0].error = std::current_exception();
+	}
+	for (auto &thread : threads) {
+		thread.join();
+	}
+	for (auto &part : parts) {
+		if (part.error) std::rethrow_exception(part.error);
+	}
+
+	//check each chunk's start against serial decoding (the previous chunk's overlap), redoing it serially if it differs:
+	// (n.b. an Overlap-long match -- several packets -- is taken to mean the decoder states agree; Opus decoders only
+	//  remember the last few packets)
+	uint32_t redone = 0;
+	for (uint32_t c = 1; c < chunks; ++c) {
+		OpusChunk &prev = parts[c - 1];
+		float *begin = data.data() + chunk_begin(c);
+		if (std::equal(prev.overlap.begin(), prev.overlap.end(), begin)) continue;
+
+		std::copy(prev.overlap.begin(), prev.overlap.end(), begin);
+		parts[c].op = std::move(prev.op);
+		decode_chunk(filename, chunk_begin(c) + prev.overlap.size(), chunk_begin(c + 1), begin + prev.overlap.size(), parts[c]);
+		++redone;
+	}
+
+	//(each message is a whole line written at once, so lines from loaders running in parallel -- see Load.hpp -- don't interleave)
+	std::cout << ("loaded '" + filename + "' (" + std::to_string(chunks) + " threads"
+		+ (redone ? ", " + std::to_string(redone) + " chunks redone serially" : std::string()) + ").\n");
+}
+
+OpusStreamDecoder::OpusStreamDecoder(std::string const &filename_) : filename(filename_) {
+	int err = 0;
+	op = op_open_file(filename.c_str(), &err);
+	if (err != 0 || !op) {
+		throw std::runtime_error("opusfile error " + std::to_string(err) + " opening \"" + filename + "\".");
+	}
+	pcm.resize(2*48000/10); //100ms of stereo; reads are generally 960 samples (20ms)
+}
+
+OpusStreamDecoder::~OpusStreamDecoder() {
+	if (op) {
+		op_free(op);
+		op = nullptr;
+	}
+}
+
+uint32_t OpusStreamDecoder::read(float *data, uint32_t count) {
+	assert(op);
+	count = std::min(count, uint32_t(pcm.size() / 2));
+	int ret = op_read_float_stereo(op, pcm.data(), int(2 * count));
+	if (ret < 0) {
+		throw std::runtime_error("opusfile read error " + std::to_string(ret) + " reading \"" + filename + "\".");
+	}
+	for (uint32_t i = 0; i < uint32_t(ret); ++i) {
+		data[i] = (pcm[2*i] + pcm[2*i+1]) * 0.5f; //downmix to mono by averaging
+	}
+	return uint32_t(ret);
+}
+
+void OpusStreamDecoder::seek(uint64_t position) {
+	assert(op);
+	int ret = op_pcm_seek(op, ogg_int64_t(position));
+	if (ret != 0) {
+		throw std::runtime_error("opusfile seek error " + std::to_string(ret) + " in \"" + filename + "\".");
+	}
 }
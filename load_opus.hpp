@@ -2,6 +2,31 @@
 
 #include <string>
 #include <vector>
+#include <cstdint>
 
 //Load an opus file as 48kHz floating-point mono; throws on error:
+// (long files are split into chunks and decoded on several threads)
 void load_opus(std::string const &filename, std::vector< float > *data);
+
+//(opaque opusfile handle)
+struct OggOpusFile;
+
+//Decode an opus file as 48kHz floating-point mono a bit at a time (used by Sound::StreamSample):
+struct OpusStreamDecoder {
+	//open file; throws on error:
+	OpusStreamDecoder(std::string const &filename);
+	~OpusStreamDecoder();
+
+	//decode up to 'count' samples into 'data'; returns the number of samples decoded (0 at end of file); throws on error:
+	uint32_t read(float *data, uint32_t count);
+
+	//move to sample 'position' (seeking to 0 is how looping streams restart); throws on error:
+	void seek(uint64_t position);
+
+	std::string filename;
+	OggOpusFile *op = nullptr;
+	std::vector< float > pcm; //stereo scratch buffer
+
+	OpusStreamDecoder(OpusStreamDecoder const &) = delete;
+	OpusStreamDecoder &operator=(OpusStreamDecoder const &) = delete;
+};
@@ -1,8 +1,10 @@
 #include "load_wav.hpp"
+#include "convert_audio.hpp"
 
 #include <SDL.h>
 
 #include <iostream>
+#include <sstream>
 #include <cassert>
 #include <algorithm>
 
@@ -21,22 +23,22 @@ void load_wav(std::string const &filename, std::vector< float > *data_) {
 		throw std::runtime_error("Failed to load WAV file '" + filename + "'; SDL says \"" + std::string(SDL_GetError()) + "\"");
 	}
 
-	//based on the SDL_AudioCVT example in the docs: https://wiki.libsdl.org/SDL_AudioCVT
-	SDL_AudioCVT cvt;
-	SDL_BuildAudioCVT(&cvt, have->format, have->channels, have->freq, AUDIO_F32SYS, 1, AUDIO_RATE);
-	if (cvt.needed) {
-		std::cout << "WAV file '" + filename + "' didn't load as " + std::to_string(AUDIO_RATE) + " Hz, float32, mono; converting." << std::endl;
-		cvt.len = audio_len;
-		cvt.buf = (Uint8 *)SDL_malloc(cvt.len * cvt.len_mult);
-		SDL_memcpy(cvt.buf, audio_buf, audio_len);
-		SDL_ConvertAudio(&cvt);
-		int final_size = cvt.len_cvt;
-		assert(final_size >= 0 && final_size <= cvt.len * cvt.len_mult && "Converted audio should fit in buffer.");
-		assert(final_size % 4 == 0 && "Converted audio should consist of 4-byte elements.");
-		data.assign(reinterpret_cast< float * >(cvt.buf), reinterpret_cast< float * >(cvt.buf + final_size));
-		SDL_free(cvt.buf);
-	} else {
+	if (have->format == AUDIO_F32SYS && have->channels == 1 && uint32_t(have->freq) == AUDIO_RATE) {
 		data.assign(reinterpret_cast< float * >(audio_buf), reinterpret_cast< float * >(audio_buf + audio_len));
+	} else {
+		//(each message is a whole line written at once, so lines from loaders running in parallel -- see Load.hpp -- don't interleave)
+		std::cout << ("WAV file '" + filename + "' didn't load as " + std::to_string(AUDIO_RATE) + " Hz, float32, mono; converting.\n");
+		//convert straight into 'data' in one pass:
+		try {
+			AudioConverter converter(have->format, have->channels, uint32_t(have->freq));
+			data.clear();
+			data.reserve(size_t(converter.output_size(audio_len / converter.frame_bytes)));
+			converter.convert(audio_buf, audio_len, &data);
+			converter.finish(&data);
+		} catch (...) {
+			SDL_FreeWAV(audio_buf);
+			throw;
+		}
 	}
 	SDL_FreeWAV(audio_buf);
 
@@ -46,5 +48,7 @@ void load_wav(std::string const &filename, std::vector< float > *data_) {
 		min = std::min(min, d);
 		max = std::max(max, d);
 	}
-	std::cout << "Range: " << min << ", " << max << std::endl;
+	std::ostringstream range;
+	range << "Range of '" << filename << "': " << min << ", " << max << "\n";
+	std::cout << range.str();
 }
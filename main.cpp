@@ -181,6 +181,9 @@ int main(int argc, char **argv) {
 
 			Mode::current->update(elapsed);
 			if (!Mode::current) break;
+
+			//reclaim voices that finished playing:
+			Sound::collect();
 		}
 
 		{ //(3) call the current mode's "draw" function to produce output:
@@ -0,0 +1,564 @@
+#include "mix_kernel.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define MIX_KERNEL_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+//gcc and clang need to be told which functions may use instructions beyond the base ISA:
+#if defined(MIX_KERNEL_X86) && (defined(__GNUC__) || defined(__clang__))
+#define MIX_KERNEL_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define MIX_KERNEL_TARGET_AVX2
+#endif
+
+namespace {
+
+typedef void (*MixMonoToStereoFn)(float *, float const *, uint32_t, float, float, float, float);
+typedef void (*MixInt16ToStereoFn)(float *, int16_t const *, uint32_t, float, float, float, float);
+typedef float (*DotProductFn)(float const *, float const *, uint32_t);
+typedef void (*MixAddFn)(float *, float const *, uint32_t);
+typedef void (*FFTButterfliesFn)(float *, float *, float *, float *, float const *, float const *, uint32_t);
+typedef void (*ComplexMultiplyAddFn)(float *, float *, float const *, float const *, float const *, float const *, uint32_t);
+typedef void (*Pan3DFn)(PanListener const &, float const *, float const *, float const *, float const *, uint32_t, float *, float *);
+
+//Equal-power pan law: with u = (pi/4) * amt for amt in [-1,1],
+//  left  = cos(pi/4 + u) = sqrt(1/2) * (cos(u) - sin(u))
+//  right = sin(pi/4 + u) = sqrt(1/2) * (cos(u) + sin(u))
+// where sin(u) and cos(u) come from their Taylor series through u^7 and u^8;
+// since |u| <= pi/4 the truncation error is below 4e-7, and all kernels evaluate the same operations in the
+// same order (no FMA) so they give identical results.
+constexpr float const PAN_SCALE = 0.78539816f; //pi/4
+constexpr float const PAN_SQRT_HALF = 0.70710678f;
+constexpr float const SIN_C3 = -1.0f / 6.0f;
+constexpr float const SIN_C5 = 1.0f / 120.0f;
+constexpr float const SIN_C7 = -1.0f / 5040.0f;
+constexpr float const COS_C2 = -1.0f / 2.0f;
+constexpr float const COS_C4 = 1.0f / 24.0f;
+constexpr float const COS_C6 = -1.0f / 720.0f;
+constexpr float const COS_C8 = 1.0f / 40320.0f;
+
+//---------- scalar ----------
+
+void mix_mono_to_stereo_scalar(float *out, float const *in, uint32_t count, float gain_l, float gain_r, float step_l, float step_r) {
+	for (uint32_t i = 0; i < count; ++i) {
+		out[2*i+0] += (gain_l + float(i) * step_l) * in[i];
+		out[2*i+1] += (gain_r + float(i) * step_r) * in[i];
+	}
+}
+
+void mix_int16_to_stereo_scalar(float *out, int16_t const *in, uint32_t count, float gain_l, float gain_r, float step_l, float step_r) {
+	//(scaling gains by a power of two is exact, so this matches converting samples to float first)
+	gain_l *= (1.0f / 32768.0f); gain_r *= (1.0f / 32768.0f);
+	step_l *= (1.0f / 32768.0f); step_r *= (1.0f / 32768.0f);
+	for (uint32_t i = 0; i < count; ++i) {
+		out[2*i+0] += (gain_l + float(i) * step_l) * float(in[i]);
+		out[2*i+1] += (gain_r + float(i) * step_r) * float(in[i]);
+	}
+}
+
+float dot_product_scalar(float const *a, float const *b, uint32_t count) {
+	float sum = 0.0f;
+	for (uint32_t i = 0; i < count; ++i) {
+		sum += a[i] * b[i];
+	}
+	return sum;
+}
+
+void mix_add_scalar(float *out, float const *in, uint32_t count) {
+	for (uint32_t i = 0; i < count; ++i) {
+		out[i] += in[i];
+	}
+}
+
+void pan_3d_scalar(PanListener const &listener, float const *x, float const *y, float const *z, float const *radius, uint32_t count, float *left, float *right) {
+	for (uint32_t i = 0; i < count; ++i) {
+		float tx = x[i] - listener.position[0];
+		float ty = y[i] - listener.position[1];
+		float tz = z[i] - listener.position[2];
+		float distance = std::sqrt((tx * tx + ty * ty) + tz * tz);
+		if (distance == 0.0f) {
+			left[i] = right[i] = 1.41421356f; //(matches original, unattenuated, behavior)
+			continue;
+		}
+		float dot = (listener.right[0] * tx + listener.right[1] * ty) + listener.right[2] * tz;
+		float amt = std::max(-1.0f, std::min(1.0f, dot / distance));
+
+		float u = amt * PAN_SCALE;
+		float u2 = u * u;
+		float sin_u = u * (1.0f + u2 * (SIN_C3 + u2 * (SIN_C5 + u2 * SIN_C7)));
+		float cos_u = 1.0f + u2 * (COS_C2 + u2 * (COS_C4 + u2 * (COS_C6 + u2 * COS_C8)));
+
+		//linear distance attenuation, 0.5 at the half-volume radius:
+		float att = 1.0f / (1.0f + distance / radius[i]);
+		float scale = PAN_SQRT_HALF * att;
+		left[i] = (cos_u - sin_u) * scale;
+		right[i] = (cos_u + sin_u) * scale;
+	}
+}
+
+void fft_butterflies_scalar(float *a_re, float *a_im, float *b_re, float *b_im, float const *w_re, float const *w_im, uint32_t count) {
+	for (uint32_t k = 0; k < count; ++k) {
+		float t_re = b_re[k] * w_re[k] - b_im[k] * w_im[k];
+		float t_im = b_re[k] * w_im[k] + b_im[k] * w_re[k];
+		b_re[k] = a_re[k] - t_re;
+		b_im[k] = a_im[k] - t_im;
+		a_re[k] = a_re[k] + t_re;
+		a_im[k] = a_im[k] + t_im;
+	}
+}
+
+void complex_multiply_add_scalar(float *acc_re, float *acc_im, float const *a_re, float const *a_im, float const *b_re, float const *b_im, uint32_t count) {
+	for (uint32_t k = 0; k < count; ++k) {
+		acc_re[k] += a_re[k] * b_re[k] - a_im[k] * b_im[k];
+		acc_im[k] += a_re[k] * b_im[k] + a_im[k] * b_re[k];
+	}
+}
+
+#ifdef MIX_KERNEL_X86
+
+//---------- sse2 (always available on x86-64) ----------
+
+void mix_mono_to_stereo_sse2(float *out, float const *in, uint32_t count, float gain_l, float gain_r, float step_l, float step_r) {
+	//gains for frames i+0,i+1 and i+2,i+3, stored as (l, r, l, r):
+	__m128 gain01 = _mm_setr_ps(gain_l, gain_r, gain_l + step_l, gain_r + step_r);
+	__m128 gain23 = _mm_setr_ps(gain_l + 2.0f * step_l, gain_r + 2.0f * step_r, gain_l + 3.0f * step_l, gain_r + 3.0f * step_r);
+	__m128 step4 = _mm_setr_ps(4.0f * step_l, 4.0f * step_r, 4.0f * step_l, 4.0f * step_r);
+
+	uint32_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128 x = _mm_loadu_ps(in + i);
+		__m128 x01 = _mm_unpacklo_ps(x, x); //(x0, x0, x1, x1)
+		__m128 x23 = _mm_unpackhi_ps(x, x); //(x2, x2, x3, x3)
+
+		__m128 o01 = _mm_loadu_ps(out + 2*i);
+		__m128 o23 = _mm_loadu_ps(out + 2*i + 4);
+		o01 = _mm_add_ps(o01, _mm_mul_ps(x01, gain01));
+		o23 = _mm_add_ps(o23, _mm_mul_ps(x23, gain23));
+		_mm_storeu_ps(out + 2*i, o01);
+		_mm_storeu_ps(out + 2*i + 4, o23);
+
+		gain01 = _mm_add_ps(gain01, step4);
+		gain23 = _mm_add_ps(gain23, step4);
+	}
+
+	//leftovers:
+	mix_mono_to_stereo_scalar(out + 2*i, in + i, count - i, gain_l + float(i) * step_l, gain_r + float(i) * step_r, step_l, step_r);
+}
+
+void mix_int16_to_stereo_sse2(float *out, int16_t const *in, uint32_t count, float gain_l, float gain_r, float step_l, float step_r) {
+	float scale = 1.0f / 32768.0f;
+	__m128 gain01 = _mm_setr_ps(gain_l, gain_r, gain_l + step_l, gain_r + step_r);
+	__m128 gain23 = _mm_setr_ps(gain_l + 2.0f * step_l, gain_r + 2.0f * step_r, gain_l + 3.0f * step_l, gain_r + 3.0f * step_r);
+	__m128 step4 = _mm_setr_ps(4.0f * step_l, 4.0f * step_r, 4.0f * step_l, 4.0f * step_r);
+	gain01 = _mm_mul_ps(gain01, _mm_set1_ps(scale));
+	gain23 = _mm_mul_ps(gain23, _mm_set1_ps(scale));
+	step4 = _mm_mul_ps(step4, _mm_set1_ps(scale));
+
+	uint32_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		//sign-extend four samples to 32 bits (by putting them in the high halves and shifting down):
+		__m128i x16 = _mm_loadl_epi64(reinterpret_cast< __m128i const * >(in + i));
+		__m128 x = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(x16, x16), 16));
+		__m128 x01 = _mm_unpacklo_ps(x, x); //(x0, x0, x1, x1)
+		__m128 x23 = _mm_unpackhi_ps(x, x); //(x2, x2, x3, x3)
+
+		__m128 o01 = _mm_loadu_ps(out + 2*i);
+		__m128 o23 = _mm_loadu_ps(out + 2*i + 4);
+		o01 = _mm_add_ps(o01, _mm_mul_ps(x01, gain01));
+		o23 = _mm_add_ps(o23, _mm_mul_ps(x23, gain23));
+		_mm_storeu_ps(out + 2*i, o01);
+		_mm_storeu_ps(out + 2*i + 4, o23);
+
+		gain01 = _mm_add_ps(gain01, step4);
+		gain23 = _mm_add_ps(gain23, step4);
+	}
+
+	//leftovers:
+	mix_int16_to_stereo_scalar(out + 2*i, in + i, count - i, gain_l + float(i) * step_l, gain_r + float(i) * step_r, step_l, step_r);
+}
+
+float dot_product_sse2(float const *a, float const *b, uint32_t count) {
+	//two accumulators to hide add latency:
+	__m128 sum0 = _mm_setzero_ps();
+	__m128 sum1 = _mm_setzero_ps();
+	uint32_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+		sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+	}
+	__m128 sum = _mm_add_ps(sum0, sum1);
+	sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum)); //(0+2, 1+3, ...)
+	sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1)); //(0+2+1+3, ...)
+
+	//leftovers:
+	return _mm_cvtss_f32(sum) + dot_product_scalar(a + i, b + i, count - i);
+}
+
+void mix_add_sse2(float *out, float const *in, uint32_t count) {
+	uint32_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		_mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i), _mm_loadu_ps(in + i)));
+	}
+	mix_add_scalar(out + i, in + i, count - i);
+}
+
+void pan_3d_sse2(PanListener const &listener, float const *x, float const *y, float const *z, float const *radius, uint32_t count, float *left, float *right) {
+	__m128 lx = _mm_set1_ps(listener.position[0]);
+	__m128 ly = _mm_set1_ps(listener.position[1]);
+	__m128 lz = _mm_set1_ps(listener.position[2]);
+	__m128 rx = _mm_set1_ps(listener.right[0]);
+	__m128 ry = _mm_set1_ps(listener.right[1]);
+	__m128 rz = _mm_set1_ps(listener.right[2]);
+	__m128 one = _mm_set1_ps(1.0f);
+
+	uint32_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128 tx = _mm_sub_ps(_mm_loadu_ps(x + i), lx);
+		__m128 ty = _mm_sub_ps(_mm_loadu_ps(y + i), ly);
+		__m128 tz = _mm_sub_ps(_mm_loadu_ps(z + i), lz);
+		__m128 distance = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, tx), _mm_mul_ps(ty, ty)), _mm_mul_ps(tz, tz)));
+		__m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(rx, tx), _mm_mul_ps(ry, ty)), _mm_mul_ps(rz, tz));
+		__m128 amt = _mm_max_ps(_mm_set1_ps(-1.0f), _mm_min_ps(one, _mm_div_ps(dot, distance)));
+
+		__m128 u = _mm_mul_ps(amt, _mm_set1_ps(PAN_SCALE));
+		__m128 u2 = _mm_mul_ps(u, u);
+		__m128 sin_u = _mm_add_ps(_mm_set1_ps(SIN_C5), _mm_mul_ps(u2, _mm_set1_ps(SIN_C7)));
+		sin_u = _mm_add_ps(_mm_set1_ps(SIN_C3), _mm_mul_ps(u2, sin_u));
+		sin_u = _mm_mul_ps(u, _mm_add_ps(one, _mm_mul_ps(u2, sin_u)));
+		__m128 cos_u = _mm_add_ps(_mm_set1_ps(COS_C6), _mm_mul_ps(u2, _mm_set1_ps(COS_C8)));
+		cos_u = _mm_add_ps(_mm_set1_ps(COS_C4), _mm_mul_ps(u2, cos_u));
+		cos_u = _mm_add_ps(_mm_set1_ps(COS_C2), _mm_mul_ps(u2, cos_u));
+		cos_u = _mm_add_ps(one, _mm_mul_ps(u2, cos_u));
+
+		__m128 att = _mm_div_ps(one, _mm_add_ps(one, _mm_div_ps(distance, _mm_loadu_ps(radius + i))));
+		__m128 scale = _mm_mul_ps(_mm_set1_ps(PAN_SQRT_HALF), att);
+		__m128 l = _mm_mul_ps(_mm_sub_ps(cos_u, sin_u), scale);
+		__m128 r = _mm_mul_ps(_mm_add_ps(cos_u, sin_u), scale);
+
+		//sources right at the listener get the (unattenuated) centered gain:
+		__m128 at_listener = _mm_cmpeq_ps(distance, _mm_setzero_ps());
+		__m128 center = _mm_and_ps(at_listener, _mm_set1_ps(1.41421356f));
+		_mm_storeu_ps(left + i, _mm_or_ps(center, _mm_andnot_ps(at_listener, l)));
+		_mm_storeu_ps(right + i, _mm_or_ps(center, _mm_andnot_ps(at_listener, r)));
+	}
+
+	//leftovers:
+	pan_3d_scalar(listener, x + i, y + i, z + i, radius + i, count - i, left + i, right + i);
+}
+
+void fft_butterflies_sse2(float *a_re, float *a_im, float *b_re, float *b_im, float const *w_re, float const *w_im, uint32_t count) {
+	uint32_t k = 0;
+	for (; k + 4 <= count; k += 4) {
+		__m128 br = _mm_loadu_ps(b_re + k), bi = _mm_loadu_ps(b_im + k);
+		__m128 wr = _mm_loadu_ps(w_re + k), wi = _mm_loadu_ps(w_im + k);
+		__m128 tr = _mm_sub_ps(_mm_mul_ps(br, wr), _mm_mul_ps(bi, wi));
+		__m128 ti = _mm_add_ps(_mm_mul_ps(br, wi), _mm_mul_ps(bi, wr));
+		__m128 ar = _mm_loadu_ps(a_re + k), ai = _mm_loadu_ps(a_im + k);
+		_mm_storeu_ps(b_re + k, _mm_sub_ps(ar, tr));
+		_mm_storeu_ps(b_im + k, _mm_sub_ps(ai, ti));
+		_mm_storeu_ps(a_re + k, _mm_add_ps(ar, tr));
+		_mm_storeu_ps(a_im + k, _mm_add_ps(ai, ti));
+	}
+	fft_butterflies_scalar(a_re + k, a_im + k, b_re + k, b_im + k, w_re + k, w_im + k, count - k);
+}
+
+void complex_multiply_add_sse2(float *acc_re, float *acc_im, float const *a_re, float const *a_im, float const *b_re, float const *b_im, uint32_t count) {
+	uint32_t k = 0;
+	for (; k + 4 <= count; k += 4) {
+		__m128 ar = _mm_loadu_ps(a_re + k), ai = _mm_loadu_ps(a_im + k);
+		__m128 br = _mm_loadu_ps(b_re + k), bi = _mm_loadu_ps(b_im + k);
+		__m128 re = _mm_sub_ps(_mm_mul_ps(ar, br), _mm_mul_ps(ai, bi));
+		__m128 im = _mm_add_ps(_mm_mul_ps(ar, bi), _mm_mul_ps(ai, br));
+		_mm_storeu_ps(acc_re + k, _mm_add_ps(_mm_loadu_ps(acc_re + k), re));
+		_mm_storeu_ps(acc_im + k, _mm_add_ps(_mm_loadu_ps(acc_im + k), im));
+	}
+	complex_multiply_add_scalar(acc_re + k, acc_im + k, a_re + k, a_im + k, b_re + k, b_im + k, count - k);
+}
+
+//---------- avx2 ----------
+
+MIX_KERNEL_TARGET_AVX2
+void mix_mono_to_stereo_avx2(float *out, float const *in, uint32_t count, float gain_l, float gain_r, float step_l, float step_r) {
+	//gains for frames i+0..i+3 and i+4..i+7, stored as (l, r, l, r, ...):
+	__m256 gain03 = _mm256_setr_ps(
+		gain_l, gain_r,
+		gain_l + step_l, gain_r + step_r,
+		gain_l + 2.0f * step_l, gain_r + 2.0f * step_r,
+		gain_l + 3.0f * step_l, gain_r + 3.0f * step_r
+	);
+	__m256 step4 = _mm256_setr_ps(
+		4.0f * step_l, 4.0f * step_r, 4.0f * step_l, 4.0f * step_r,
+		4.0f * step_l, 4.0f * step_r, 4.0f * step_l, 4.0f * step_r
+	);
+	__m256 gain47 = _mm256_add_ps(gain03, step4);
+	__m256 step8 = _mm256_add_ps(step4, step4);
+
+	uint32_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256 x = _mm256_loadu_ps(in + i);
+		__m256 lo = _mm256_unpacklo_ps(x, x); //(x0, x0, x1, x1 | x4, x4, x5, x5)
+		__m256 hi = _mm256_unpackhi_ps(x, x); //(x2, x2, x3, x3 | x6, x6, x7, x7)
+		__m256 x03 = _mm256_permute2f128_ps(lo, hi, 0x20); //(x0, x0, x1, x1, x2, x2, x3, x3)
+		__m256 x47 = _mm256_permute2f128_ps(lo, hi, 0x31); //(x4, x4, x5, x5, x6, x6, x7, x7)
+
+		__m256 o03 = _mm256_loadu_ps(out + 2*i);
+		__m256 o47 = _mm256_loadu_ps(out + 2*i + 8);
+		o03 = _mm256_add_ps(o03, _mm256_mul_ps(x03, gain03));
+		o47 = _mm256_add_ps(o47, _mm256_mul_ps(x47, gain47));
+		_mm256_storeu_ps(out + 2*i, o03);
+		_mm256_storeu_ps(out + 2*i + 8, o47);
+
+		gain03 = _mm256_add_ps(gain03, step8);
+		gain47 = _mm256_add_ps(gain47, step8);
+	}
+
+	//leftovers:
+	mix_mono_to_stereo_sse2(out + 2*i, in + i, count - i, gain_l + float(i) * step_l, gain_r + float(i) * step_r, step_l, step_r);
+}
+
+MIX_KERNEL_TARGET_AVX2
+void mix_int16_to_stereo_avx2(float *out, int16_t const *in, uint32_t count, float gain_l, float gain_r, float step_l, float step_r) {
+	float scale = 1.0f / 32768.0f;
+	__m256 gain03 = _mm256_setr_ps(
+		gain_l, gain_r,
+		gain_l + step_l, gain_r + step_r,
+		gain_l + 2.0f * step_l, gain_r + 2.0f * step_r,
+		gain_l + 3.0f * step_l, gain_r + 3.0f * step_r
+	);
+	__m256 step4 = _mm256_setr_ps(
+		4.0f * step_l, 4.0f * step_r, 4.0f * step_l, 4.0f * step_r,
+		4.0f * step_l, 4.0f * step_r, 4.0f * step_l, 4.0f * step_r
+	);
+	__m256 gain47 = _mm256_add_ps(gain03, step4);
+	__m256 step8 = _mm256_add_ps(step4, step4);
+	gain03 = _mm256_mul_ps(gain03, _mm256_set1_ps(scale));
+	gain47 = _mm256_mul_ps(gain47, _mm256_set1_ps(scale));
+	step8 = _mm256_mul_ps(step8, _mm256_set1_ps(scale));
+
+	uint32_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256 x = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast< __m128i const * >(in + i))));
+		__m256 lo = _mm256_unpacklo_ps(x, x); //(x0, x0, x1, x1 | x4, x4, x5, x5)
+		__m256 hi = _mm256_unpackhi_ps(x, x); //(x2, x2, x3, x3 | x6, x6, x7, x7)
+		__m256 x03 = _mm256_permute2f128_ps(lo, hi, 0x20);
+		__m256 x47 = _mm256_permute2f128_ps(lo, hi, 0x31);
+
+		__m256 o03 = _mm256_loadu_ps(out + 2*i);
+		__m256 o47 = _mm256_loadu_ps(out + 2*i + 8);
+		o03 = _mm256_add_ps(o03, _mm256_mul_ps(x03, gain03));
+		o47 = _mm256_add_ps(o47, _mm256_mul_ps(x47, gain47));
+		_mm256_storeu_ps(out + 2*i, o03);
+		_mm256_storeu_ps(out + 2*i + 8, o47);
+
+		gain03 = _mm256_add_ps(gain03, step8);
+		gain47 = _mm256_add_ps(gain47, step8);
+	}
+
+	//leftovers:
+	mix_int16_to_stereo_sse2(out + 2*i, in + i, count - i, gain_l + float(i) * step_l, gain_r + float(i) * step_r, step_l, step_r);
+}
+
+MIX_KERNEL_TARGET_AVX2
+float dot_product_avx2(float const *a, float const *b, uint32_t count) {
+	__m256 sum0 = _mm256_setzero_ps();
+	__m256 sum1 = _mm256_setzero_ps();
+	uint32_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		sum0 = _mm256_add_ps(sum0, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+		sum1 = _mm256_add_ps(sum1, _mm256_mul_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8)));
+	}
+	__m256 sum8 = _mm256_add_ps(sum0, sum1);
+	__m128 sum = _mm_add_ps(_mm256_castps256_ps128(sum8), _mm256_extractf128_ps(sum8, 1));
+	sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+	sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+
+	//leftovers:
+	return _mm_cvtss_f32(sum) + dot_product_sse2(a + i, b + i, count - i);
+}
+
+MIX_KERNEL_TARGET_AVX2
+void mix_add_avx2(float *out, float const *in, uint32_t count) {
+	uint32_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		_mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_loadu_ps(out + i), _mm256_loadu_ps(in + i)));
+	}
+	mix_add_sse2(out + i, in + i, count - i);
+}
+
+MIX_KERNEL_TARGET_AVX2
+void pan_3d_avx2(PanListener const &listener, float const *x, float const *y, float const *z, float const *radius, uint32_t count, float *left, float *right) {
+	__m256 lx = _mm256_set1_ps(listener.position[0]);
+	__m256 ly = _mm256_set1_ps(listener.position[1]);
+	__m256 lz = _mm256_set1_ps(listener.position[2]);
+	__m256 rx = _mm256_set1_ps(listener.right[0]);
+	__m256 ry = _mm256_set1_ps(listener.right[1]);
+	__m256 rz = _mm256_set1_ps(listener.right[2]);
+	__m256 one = _mm256_set1_ps(1.0f);
+
+	uint32_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256 tx = _mm256_sub_ps(_mm256_loadu_ps(x + i), lx);
+		__m256 ty = _mm256_sub_ps(_mm256_loadu_ps(y + i), ly);
+		__m256 tz = _mm256_sub_ps(_mm256_loadu_ps(z + i), lz);
+		__m256 distance = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(tx, tx), _mm256_mul_ps(ty, ty)), _mm256_mul_ps(tz, tz)));
+		__m256 dot = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(rx, tx), _mm256_mul_ps(ry, ty)), _mm256_mul_ps(rz, tz));
+		__m256 amt = _mm256_max_ps(_mm256_set1_ps(-1.0f), _mm256_min_ps(one, _mm256_div_ps(dot, distance)));
+
+		__m256 u = _mm256_mul_ps(amt, _mm256_set1_ps(PAN_SCALE));
+		__m256 u2 = _mm256_mul_ps(u, u);
+		__m256 sin_u = _mm256_add_ps(_mm256_set1_ps(SIN_C5), _mm256_mul_ps(u2, _mm256_set1_ps(SIN_C7)));
+		sin_u = _mm256_add_ps(_mm256_set1_ps(SIN_C3), _mm256_mul_ps(u2, sin_u));
+		sin_u = _mm256_mul_ps(u, _mm256_add_ps(one, _mm256_mul_ps(u2, sin_u)));
+		__m256 cos_u = _mm256_add_ps(_mm256_set1_ps(COS_C6), _mm256_mul_ps(u2, _mm256_set1_ps(COS_C8)));
+		cos_u = _mm256_add_ps(_mm256_set1_ps(COS_C4), _mm256_mul_ps(u2, cos_u));
+		cos_u = _mm256_add_ps(_mm256_set1_ps(COS_C2), _mm256_mul_ps(u2, cos_u));
+		cos_u = _mm256_add_ps(one, _mm256_mul_ps(u2, cos_u));
+
+		__m256 att = _mm256_div_ps(one, _mm256_add_ps(one, _mm256_div_ps(distance, _mm256_loadu_ps(radius + i))));
+		__m256 scale = _mm256_mul_ps(_mm256_set1_ps(PAN_SQRT_HALF), att);
+		__m256 l = _mm256_mul_ps(_mm256_sub_ps(cos_u, sin_u), scale);
+		__m256 r = _mm256_mul_ps(_mm256_add_ps(cos_u, sin_u), scale);
+
+		//sources right at the listener get the (unattenuated) centered gain:
+		__m256 at_listener = _mm256_cmp_ps(distance, _mm256_setzero_ps(), _CMP_EQ_OQ);
+		__m256 center = _mm256_set1_ps(1.41421356f);
+		_mm256_storeu_ps(left + i, _mm256_blendv_ps(l, center, at_listener));
+		_mm256_storeu_ps(right + i, _mm256_blendv_ps(r, center, at_listener));
+	}
+
+	//leftovers:
+	pan_3d_sse2(listener, x + i, y + i, z + i, radius + i, count - i, left + i, right + i);
+}
+
+MIX_KERNEL_TARGET_AVX2
+void fft_butterflies_avx2(float *a_re, float *a_im, float *b_re, float *b_im, float const *w_re, float const *w_im, uint32_t count) {
+	uint32_t k = 0;
+	for (; k + 8 <= count; k += 8) {
+		__m256 br = _mm256_loadu_ps(b_re + k), bi = _mm256_loadu_ps(b_im + k);
+		__m256 wr = _mm256_loadu_ps(w_re + k), wi = _mm256_loadu_ps(w_im + k);
+		__m256 tr = _mm256_sub_ps(_mm256_mul_ps(br, wr), _mm256_mul_ps(bi, wi));
+		__m256 ti = _mm256_add_ps(_mm256_mul_ps(br, wi), _mm256_mul_ps(bi, wr));
+		__m256 ar = _mm256_loadu_ps(a_re + k), ai = _mm256_loadu_ps(a_im + k);
+		_mm256_storeu_ps(b_re + k, _mm256_sub_ps(ar, tr));
+		_mm256_storeu_ps(b_im + k, _mm256_sub_ps(ai, ti));
+		_mm256_storeu_ps(a_re + k, _mm256_add_ps(ar, tr));
+		_mm256_storeu_ps(a_im + k, _mm256_add_ps(ai, ti));
+	}
+	fft_butterflies_sse2(a_re + k, a_im + k, b_re + k, b_im + k, w_re + k, w_im + k, count - k);
+}
+
+MIX_KERNEL_TARGET_AVX2
+void complex_multiply_add_avx2(float *acc_re, float *acc_im, float const *a_re, float const *a_im, float const *b_re, float const *b_im, uint32_t count) {
+	uint32_t k = 0;
+	for (; k + 8 <= count; k += 8) {
+		__m256 ar = _mm256_loadu_ps(a_re + k), ai = _mm256_loadu_ps(a_im + k);
+		__m256 br = _mm256_loadu_ps(b_re + k), bi = _mm256_loadu_ps(b_im + k);
+		__m256 re = _mm256_sub_ps(_mm256_mul_ps(ar, br), _mm256_mul_ps(ai, bi));
+		__m256 im = _mm256_add_ps(_mm256_mul_ps(ar, bi), _mm256_mul_ps(ai, br));
+		_mm256_storeu_ps(acc_re + k, _mm256_add_ps(_mm256_loadu_ps(acc_re + k), re));
+		_mm256_storeu_ps(acc_im + k, _mm256_add_ps(_mm256_loadu_ps(acc_im + k), im));
+	}
+	complex_multiply_add_sse2(acc_re + k, acc_im + k, a_re + k, a_im + k, b_re + k, b_im + k, count - k);
+}
+
+bool cpu_has_avx2() {
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) return false;
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	if (!(osxsave && avx)) return false;
+	//check that the OS saves ymm registers on context switch:
+	if ((_xgetbv(0) & 0x6) != 0x6) return false;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif //MIX_KERNEL_X86
+
+struct Kernels {
+	MixMonoToStereoFn mix_mono_to_stereo = mix_mono_to_stereo_scalar;
+	MixInt16ToStereoFn mix_int16_to_stereo = mix_int16_to_stereo_scalar;
+	DotProductFn dot_product = dot_product_scalar;
+	MixAddFn mix_add = mix_add_scalar;
+	Pan3DFn pan_3d = pan_3d_scalar;
+	FFTButterfliesFn fft_butterflies = fft_butterflies_scalar;
+	ComplexMultiplyAddFn complex_multiply_add = complex_multiply_add_scalar;
+	char const *name = "scalar";
+	Kernels() {
+#ifdef MIX_KERNEL_X86
+		if (cpu_has_avx2()) {
+			mix_mono_to_stereo = mix_mono_to_stereo_avx2;
+			mix_int16_to_stereo = mix_int16_to_stereo_avx2;
+			dot_product = dot_product_avx2;
+			mix_add = mix_add_avx2;
+			pan_3d = pan_3d_avx2;
+			fft_butterflies = fft_butterflies_avx2;
+			complex_multiply_add = complex_multiply_add_avx2;
+			name = "avx2";
+		} else {
+			mix_mono_to_stereo = mix_mono_to_stereo_sse2;
+			mix_int16_to_stereo = mix_int16_to_stereo_sse2;
+			dot_product = dot_product_sse2;
+			mix_add = mix_add_sse2;
+			pan_3d = pan_3d_sse2;
+			fft_butterflies = fft_butterflies_sse2;
+			complex_multiply_add = complex_multiply_add_sse2;
+			name = "sse2";
+		}
+#endif
+	}
+};
+
+//picked on first use (function-local static, so initialization is thread-safe):
+Kernels const &kernels() {
+	static Kernels const k;
+	return k;
+}
+
+} //namespace
+
+void mix_mono_to_stereo(float *out, float const *in, uint32_t count, float gain_l, float gain_r, float step_l, float step_r) {
+	kernels().mix_mono_to_stereo(out, in, count, gain_l, gain_r, step_l, step_r);
+}
+
+void mix_int16_to_stereo(float *out, int16_t const *in, uint32_t count, float gain_l, float gain_r, float step_l, float step_r) {
+	kernels().mix_int16_to_stereo(out, in, count, gain_l, gain_r, step_l, step_r);
+}
+
+void mix_add(float *out, float const *in, uint32_t count) {
+	kernels().mix_add(out, in, count);
+}
+
+void pan_3d(PanListener const &listener, float const *x, float const *y, float const *z, float const *radius, uint32_t count, float *left, float *right) {
+	kernels().pan_3d(listener, x, y, z, radius, count, left, right);
+}
+
+void fft_butterflies(float *a_re, float *a_im, float *b_re, float *b_im, float const *w_re, float const *w_im, uint32_t count) {
+	kernels().fft_butterflies(a_re, a_im, b_re, b_im, w_re, w_im, count);
+}
+
+void complex_multiply_add(float *acc_re, float *acc_im, float const *a_re, float const *a_im, float const *b_re, float const *b_im, uint32_t count) {
+	kernels().complex_multiply_add(acc_re, acc_im, a_re, a_im, b_re, b_im, count);
+}
+
+float dot_product(float const *a, float const *b, uint32_t count) {
+	return kernels().dot_product(a, b, count);
+}
+
+char const *mix_kernel_name() {
+	return kernels().name;
+}
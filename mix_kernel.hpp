@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+
+//Helpers used by the audio code (Sound.cpp, convert_audio.cpp) to do the per-sample work.
+//The fastest implementation supported by the running CPU (AVX2, SSE2, or plain scalar code)
+// is picked the first time one of these functions is called.
+
+//Mix 'count' mono samples into an interleaved stereo buffer ( l, r, l, r, ... ),
+// with the left/right gains ramping linearly across the run:
+//   out[2*i+0] += (gain_l + i * step_l) * in[i]
+//   out[2*i+1] += (gain_r + i * step_r) * in[i]
+void mix_mono_to_stereo(
+	float *out, float const *in, uint32_t count,
+	float gain_l, float gain_r,
+	float step_l, float step_r
+);
+
+//Same, but for 16-bit samples (each treated as in[i] / 32768.0f):
+void mix_int16_to_stereo(
+	float *out, int16_t const *in, uint32_t count,
+	float gain_l, float gain_r,
+	float step_l, float step_r
+);
+
+//Add 'count' floats from 'in' to 'out' (used to combine the output of mixing threads):
+void mix_add(float *out, float const *in, uint32_t count);
+
+//3D panning for 'count' sources at once; sources are given as arrays of x, y, z, and half-volume radius:
+// left/right are an equal-power pan (cos/sin of an angle from 0 when the source is straight left of the listener
+// to pi/2 when straight right) times a linear distance attenuation that is 0.5 at the half-volume radius;
+// a source exactly at the listener gets sqrt(2) in both channels.
+// sin/cos are approximated by polynomials, so gains differ from the std::cos/std::sin version by at most 1e-6 (times the attenuation).
+struct PanListener {
+	float position[3];
+	float right[3]; //unit vector
+};
+void pan_3d(
+	PanListener const &listener,
+	float const *x, float const *y, float const *z, float const *radius, uint32_t count,
+	float *left, float *right
+);
+
+//Radix-2 FFT butterflies on split-complex data (used by fft.cpp):
+//   t = b[k] * w[k];  b[k] = a[k] - t;  a[k] = a[k] + t
+void fft_butterflies(
+	float *a_re, float *a_im, float *b_re, float *b_im,
+	float const *w_re, float const *w_im, uint32_t count
+);
+
+//Complex multiply-accumulate on split-complex data (the spectral products in the convolution reverb):
+//   acc[k] += a[k] * b[k]
+void complex_multiply_add(
+	float *acc_re, float *acc_im,
+	float const *a_re, float const *a_im, float const *b_re, float const *b_im, uint32_t count
+);
+
+//Sum of a[i] * b[i] for i in [0, count); used by the resampler in convert_audio.cpp:
+float dot_product(float const *a, float const *b, uint32_t count);
+
+//name of the implementation in use ("avx2", "sse2", or "scalar"); handy for logging:
+char const *mix_kernel_name();
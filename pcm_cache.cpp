@@ -0,0 +1,146 @@
+#include "pcm_cache.hpp"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <cstring>
+#include <thread>
+
+//cache file layout: (all values in native byte order, since caches are never shared between machines)
+struct PCMCacheHeader {
+	char magic[4] = {'p', 'c', 'm', '0'};
+	uint32_t rate = 48000;
+	uint64_t key = 0; //hash of source file size + modification time
+	uint64_t size = 0; //number of (float) samples following the header
+	uint64_t reserved = 0; //(pads header to 32 bytes so samples are nicely aligned)
+};
+static_assert(sizeof(PCMCacheHeader) == 32, "PCMCacheHeader is packed");
+
+//helper: cache files live next to their source:
+static std::string cache_path(std::string const &source) {
+	return source + ".pcm";
+}
+
+//helper: compute cache key from source file size and modification time (returns 0 if source can't be examined):
+static uint64_t source_key(std::string const &source) {
+	std::error_code ec;
+	uint64_t size = std::filesystem::file_size(source, ec);
+	if (ec) return 0;
+	auto mtime = std::filesystem::last_write_time(source, ec);
+	if (ec) return 0;
+	uint64_t time = uint64_t(mtime.time_since_epoch().count());
+
+	//FNV-1a over the bytes of size and time:
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (uint64_t value : {size, time}) {
+		for (uint32_t i = 0; i < 8; ++i) {
+			hash ^= (value >> (8 * i)) & 0xff;
+			hash *= 0x100000001b3ULL;
+		}
+	}
+	return (hash == 0 ? 1 : hash); //(0 means "no key")
+}
+
+PCMCacheFile::~PCMCacheFile() {
+#if defined(_WIN32)
+	if (mapping) UnmapViewOfFile(mapping);
+	if (file_mapping) CloseHandle(file_mapping);
+	if (file) CloseHandle(file);
+#else
+	if (mapping) munmap(mapping, mapping_size);
+#endif
+}
+
+std::shared_ptr< PCMCacheFile const > map_pcm_cache(std::string const &source) {
+	uint64_t key = source_key(source);
+	if (key == 0) return nullptr;
+
+	std::string path = cache_path(source);
+	std::shared_ptr< PCMCacheFile > cache = std::make_shared< PCMCacheFile >();
+
+	//map the whole file read-only:
+#if defined(_WIN32)
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) return nullptr;
+	cache->file = file;
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size)) return nullptr;
+	cache->mapping_size = size_t(file_size.QuadPart);
+	if (cache->mapping_size < sizeof(PCMCacheHeader)) return nullptr;
+	cache->file_mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!cache->file_mapping) return nullptr;
+	cache->mapping = MapViewOfFile(cache->file_mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!cache->mapping) return nullptr;
+#else
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) return nullptr;
+	struct stat info;
+	if (fstat(fd, &info) != 0 || size_t(info.st_size) < sizeof(PCMCacheHeader)) {
+		close(fd);
+		return nullptr;
+	}
+	cache->mapping_size = size_t(info.st_size);
+	void *mapping = mmap(nullptr, cache->mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); //(mapping stays valid after the file is closed)
+	if (mapping == MAP_FAILED) return nullptr;
+	cache->mapping = mapping;
+#endif
+
+	//check that the cache is for this version of the source:
+	PCMCacheHeader header;
+	std::memcpy(&header, cache->mapping, sizeof(header));
+	if (std::memcmp(header.magic, PCMCacheHeader().magic, 4) != 0
+	 || header.rate != 48000
+	 || header.key != key
+	 || header.size != (cache->mapping_size - sizeof(PCMCacheHeader)) / sizeof(float)) {
+		return nullptr;
+	}
+
+	cache->data = reinterpret_cast< float const * >(reinterpret_cast< char const * >(cache->mapping) + sizeof(PCMCacheHeader));
+	cache->size = size_t(header.size);
+	return cache;
+}
+
+void save_pcm_cache(std::string const &source, std::vector< float > const &data) {
+	PCMCacheHeader header;
+	header.key = source_key(source);
+	header.size = data.size();
+	if (header.key == 0) return;
+
+	//write to a temporary file then rename it into place, so a partly-written cache is never read:
+	// (the temporary file's name includes the process and thread, since several loaders may be decoding the same file at once)
+	std::string path = cache_path(source);
+#if defined(_WIN32)
+	uint64_t pid = uint64_t(GetCurrentProcessId());
+#else
+	uint64_t pid = uint64_t(getpid());
+#endif
+	std::string temp = path + "." + std::to_string(pid) + "-" + std::to_string(std::hash< std::thread::id >()(std::this_thread::get_id())) + ".tmp";
+	{
+		std::ofstream out(temp, std::ios::binary);
+		out.write(reinterpret_cast< char const * >(&header), sizeof(header));
+		out.write(reinterpret_cast< char const * >(data.data()), data.size() * sizeof(float));
+		if (!out) {
+			std::cerr << ("WARNING: failed to write decoded audio cache '" + temp + "'.\n");
+			out.close();
+			std::error_code ec;
+			std::filesystem::remove(temp, ec);
+			return;
+		}
+	}
+	std::error_code ec;
+	std::filesystem::rename(temp, path, ec);
+	if (ec) {
+		std::cerr << ("WARNING: failed to move decoded audio cache into place as '" + path + "' (" + ec.message() + ").\n");
+		std::filesystem::remove(temp, ec);
+	}
+}
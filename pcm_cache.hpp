@@ -0,0 +1,33 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+//Cache of decoded audio, so '.opus' files only need to be decoded once (used by Sound::Sample):
+// the cache for "path/to/music.opus" is "path/to/music.opus.pcm", and holds 48kHz mono float samples
+// along with a key computed from the size and modification time of the source file;
+// if the source changes, the key no longer matches and the cache is ignored (and rewritten).
+
+//A read-only memory mapping of a cache file's samples:
+struct PCMCacheFile {
+	~PCMCacheFile();
+
+	float const *data = nullptr; //points into the mapping
+	size_t size = 0; //number of samples
+
+	//platform-specific mapping info:
+	void *mapping = nullptr; //start of mapping
+	size_t mapping_size = 0; //size of mapping in bytes
+#ifdef _WIN32
+	void *file = nullptr; //file handle
+	void *file_mapping = nullptr; //file mapping handle
+#endif
+};
+
+//Map the cache for 'source'; returns nullptr if there is no up-to-date cache:
+std::shared_ptr< PCMCacheFile const > map_pcm_cache(std::string const &source);
+
+//Write the cache for 'source'; warns (but doesn't throw) if the cache can't be written:
+void save_pcm_cache(std::string const &source, std::vector< float > const &data);
@@ -121,6 +121,9 @@ int main(int argc, char **argv) {
 				drawable.pipeline.start = mesh.start;
 				drawable.pipeline.count = mesh.count;
 
+				drawable.bounds_min = mesh.min; //(lets Scene::draw skip the drawable when it is out of view)
+				drawable.bounds_max = mesh.max;
+
 			});
 		} catch (std::exception &e) {
 			std::cerr << "ERROR loading scene '" << scene_file << "': " << e.what() << std::endl;